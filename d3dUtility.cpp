@@ -11,6 +11,8 @@
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "d3dUtility.h"
+#include <cstdio>
+#include <vector>
 
 bool d3d::InitD3D(
 	HINSTANCE hInstance,
@@ -144,32 +146,264 @@ bool d3d::InitD3D(
 	return true;
 }
 
-int d3d::EnterMsgLoop( bool (*ptr_display)(float timeDelta) )
+int d3d::EnterMsgLoop( bool (*ptr_display)(float timeDelta), double targetFps )
 {
 	MSG msg;
 	::ZeroMemory(&msg, sizeof(MSG));
 
-	static double lastTime = (double)timeGetTime(); 
+	FramePacer pacer(targetFps, SystemClock, SystemSleep);
+	bool animating = true;
+
+	::timeBeginPeriod(1); // let Sleep() wake up with millisecond precision
 
 	while(msg.message != WM_QUIT)
 	{
-		if(::PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
+		if( !animating )
+		{
+			// nothing moves: wait for input instead of redrawing the same frame.
+			// still draw twice a second, so changes from outside (reloaded files) show up
+			::MsgWaitForMultipleObjects(0, 0, FALSE, 500, QS_ALLINPUT);
+			pacer.reset();
+		}
+
+		// same time scale as before: 0.0007 per millisecond
+		double timeDelta = pacer.waitNextFrame() * 0.7;
+
+		// take everything that arrived while waiting, so a burst of input
+		// becomes one update of the next frame instead of delaying it
+		while( msg.message != WM_QUIT && ::PeekMessage(&msg, 0, 0, 0, PM_REMOVE) )
 		{
 			::TranslateMessage(&msg);
 			::DispatchMessage(&msg);
 		}
-		else
-        {	
-			double currTime  = (double)timeGetTime();
-			double timeDelta = (currTime - lastTime)*0.0007;
-			ptr_display((float)timeDelta);
+		if( msg.message == WM_QUIT )
+			break;
 
-			lastTime = currTime;
-        }
+		animating = ptr_display((float)timeDelta);
     }
+
+	::timeEndPeriod(1);
     return msg.wParam;
 }
 
+bool d3d::MeasureMesh(ID3DXMesh* mesh, MeshStats* stats, int cacheSize)
+{
+	const int MAX_CACHE = 64;
+	if( cacheSize < 1 || cacheSize > MAX_CACHE )
+		return false;
+
+	void* indices = 0;
+	if( FAILED(mesh->LockIndexBuffer(D3DLOCK_READONLY, &indices)) )
+		return false;
+
+	bool wide = (mesh->GetOptions() & D3DXMESH_32BIT) != 0;
+	DWORD count = mesh->GetNumFaces() * 3;
+	DWORD cache[MAX_CACHE];
+	int cached = 0;
+	int oldest = 0;
+	DWORD misses = 0;
+
+	for(DWORD i = 0; i < count; i++)
+	{
+		DWORD v = wide ? ((DWORD*)indices)[i] : ((WORD*)indices)[i];
+		bool hit = false;
+		for(int j = 0; j < cached && !hit; j++)
+			hit = (cache[j] == v);
+		if( hit )
+			continue;
+
+		misses++;
+		if( cached < cacheSize )
+			cache[cached++] = v;
+		else
+		{
+			cache[oldest] = v;
+			oldest = (oldest + 1) % cacheSize;
+		}
+	}
+	mesh->UnlockIndexBuffer();
+
+	stats->faces          = mesh->GetNumFaces();
+	stats->vertices       = mesh->GetNumVertices();
+	stats->bytesPerVertex = mesh->GetNumBytesPerVertex();
+	stats->acmr           = stats->faces ? (float)misses / stats->faces : 0.0f;
+	return true;
+}
+
+bool d3d::OptimizeMesh(ID3DXMesh* mesh, const char* name)
+{
+	MeshStats before;
+	if( name )
+		MeasureMesh(mesh, &before);
+
+	std::vector<DWORD> adjacency(mesh->GetNumFaces() * 3);
+	if( FAILED(mesh->GenerateAdjacency(0.0f, &adjacency[0])) )
+		return false;
+	if( FAILED(mesh->OptimizeInplace(
+		D3DXMESHOPT_ATTRSORT | D3DXMESHOPT_COMPACT | D3DXMESHOPT_VERTEXCACHE,
+		&adjacency[0], 0, 0, 0)) )
+		return false;
+
+	MeshStats after;
+	if( name && MeasureMesh(mesh, &after) )
+	{
+		char line[256];
+		sprintf(line, "%s: %lu faces, %lu vertices, %lu bytes/vertex (%lu KB), ACMR %.3f -> %.3f\n",
+			name, after.faces, after.vertices, after.bytesPerVertex,
+			after.vertices * after.bytesPerVertex / 1024, before.acmr, after.acmr);
+		::OutputDebugString(line);
+	}
+	return true;
+}
+
+double d3d::SystemClock(void)
+{
+	static LARGE_INTEGER freq = { 0 };
+	if( freq.QuadPart == 0 )
+		::QueryPerformanceFrequency(&freq);
+
+	LARGE_INTEGER now;
+	::QueryPerformanceCounter(&now);
+	return (double)now.QuadPart / (double)freq.QuadPart;
+}
+
+void d3d::SystemSleep(double sec)
+{
+	if( sec > 0.0 )
+		::Sleep((DWORD)(sec * 1000.0));
+}
+
+//
+// Tracing
+//
+
+namespace
+{
+	const int MAX_TRACE_THREADS = 8;        // threads recording at the same time
+	const int MAX_TRACE_EVENTS  = 1 << 16;  // per buffer
+
+	struct TraceRecord
+	{
+		const char* name;
+		LONGLONG    ticks;
+		DWORD       threadId;
+		char        phase;
+	};
+
+	// a buffer belongs to one thread at a time. when that thread ends the
+	// buffer goes back to the pool, and the next thread appends after the
+	// events already in it (every event keeps its own thread id).
+	struct TraceBuffer
+	{
+		volatile long owned;
+		long          epoch;    // the count belongs to this StartTracing() call
+		volatile long count;
+		TraceRecord   events[MAX_TRACE_EVENTS];
+	};
+
+	// static so that recording never allocates
+	TraceBuffer   g_traceBuffers[MAX_TRACE_THREADS];
+	volatile long g_traceEpoch = 0;
+
+	struct TraceSlot
+	{
+		TraceSlot() : index(-1) {}
+		~TraceSlot()
+		{
+			if( index >= 0 )
+				::InterlockedExchange(&g_traceBuffers[index].owned, 0);
+		}
+
+		int index;
+	};
+	thread_local TraceSlot t_traceSlot;
+}
+
+volatile bool d3d::TracingOn = false;
+
+// only the owner of a buffer ever writes its count: StartTracing() starts a new
+// epoch, and each owner empties its buffer when it sees the epoch change
+void d3d::StartTracing(void)
+{
+	::InterlockedIncrement(&g_traceEpoch);
+	TracingOn = true;
+}
+
+void d3d::TraceEvent(const char* name, char phase)
+{
+	if( t_traceSlot.index < 0 )
+	{
+		// first event of this thread: claim a free buffer
+		for( int i = 0; i < MAX_TRACE_THREADS && t_traceSlot.index < 0; i++ )
+		{
+			if( ::InterlockedCompareExchange(&g_traceBuffers[i].owned, 1, 0) == 0 )
+				t_traceSlot.index = i;
+		}
+		if( t_traceSlot.index < 0 )
+			return;
+	}
+
+	TraceBuffer& buffer = g_traceBuffers[t_traceSlot.index];
+	long epoch = g_traceEpoch;
+	if( buffer.epoch != epoch )
+	{
+		buffer.count = 0;
+		buffer.epoch = epoch;
+	}
+	long n = buffer.count;
+	if( n >= MAX_TRACE_EVENTS )
+		return;
+
+	LARGE_INTEGER now;
+	::QueryPerformanceCounter(&now);
+
+	TraceRecord& record = buffer.events[n];
+	record.name     = name;
+	record.ticks    = now.QuadPart;
+	record.threadId = ::GetCurrentThreadId();
+	record.phase    = phase;
+	buffer.count = n + 1;   // publish the record
+}
+
+bool d3d::StopTracing(const char* fileName)
+{
+	TracingOn = false;
+
+	FILE* file = fopen(fileName, "w");
+	if( !file )
+		return false;
+
+	LARGE_INTEGER freq;
+	::QueryPerformanceFrequency(&freq);
+	double toMicroseconds = 1000000.0 / (double)freq.QuadPart;
+
+	long epoch = g_traceEpoch;
+	bool first = true;
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	for( int t = 0; t < MAX_TRACE_THREADS; t++ )
+	{
+		// buffers not written since StartTracing() hold an older trace
+		const TraceBuffer& buffer = g_traceBuffers[t];
+		if( buffer.epoch != epoch )
+			continue;
+
+		long count = buffer.count;
+		for( long i = 0; i < count; i++ )
+		{
+			const TraceRecord& record = buffer.events[i];
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%lu,\"tid\":%lu}",
+				first ? "" : ",\n", record.name, record.phase, record.ticks * toMicroseconds,
+				::GetCurrentProcessId(), record.threadId);
+			first = false;
+		}
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	return true;
+}
+
 D3DLIGHT9 d3d::InitDirectionalLight(D3DXVECTOR3* direction, D3DXCOLOR* color)
 {
 	D3DLIGHT9 light;
@@ -265,3 +499,65 @@ d3d::BoundingSphere::BoundingSphere()
 {
 	_radius = 0.0f;
 }
+
+d3d::SphereBatch::SphereBatch()
+{
+	_count = 0;
+}
+
+int d3d::SphereBatch::add(const D3DXVECTOR3& center, float radius)
+{
+	if( _count >= CAPACITY )
+		return -1;
+
+	_x[_count]       = center.x;
+	_y[_count]       = center.y;
+	_z[_count]       = center.z;
+	_radius[_count]  = radius;
+	_visible[_count] = true;
+	return _count++;
+}
+
+void d3d::Frustum::build(const D3DXMATRIX& m)
+{
+	// Gribb/Hartmann: combine the columns of the matrix (D3D clip z is 0..1)
+	_planes[0] = D3DXPLANE(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41); // left
+	_planes[1] = D3DXPLANE(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41); // right
+	_planes[2] = D3DXPLANE(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42); // bottom
+	_planes[3] = D3DXPLANE(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42); // top
+	_planes[4] = D3DXPLANE(m._13,         m._23,         m._33,         m._43);         // near
+	_planes[5] = D3DXPLANE(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43); // far
+
+	for( int i = 0; i < 6; i++ )
+		D3DXPlaneNormalize(&_planes[i], &_planes[i]);
+}
+
+int d3d::Frustum::cull(SphereBatch& batch) const
+{
+	float inside[SphereBatch::CAPACITY];
+	int i, p;
+
+	for( i = 0; i < batch._count; i++ )
+		inside[i] = 1.0f;
+
+	// plane by plane over all spheres: no branches in the inner loop,
+	// so the compiler vectorizes it
+	for( p = 0; p < 6; p++ )
+	{
+		const float a = _planes[p].a, b = _planes[p].b, c = _planes[p].c, d = _planes[p].d;
+		for( i = 0; i < batch._count; i++ )
+		{
+			float dist = a * batch._x[i] + b * batch._y[i] + c * batch._z[i] + d;
+			inside[i] = (dist < -batch._radius[i]) ? 0.0f : inside[i];
+		}
+	}
+
+	int culled = 0;
+	for( i = 0; i < batch._count; i++ )
+	{
+		batch._visible[i] = inside[i] != 0.0f;
+		if( !batch._visible[i] )
+			culled++;
+	}
+	return culled;
+}
@@ -16,6 +16,7 @@
 #include <d3dx9.h>
 #include <string>
 #include <limits>
+#include "pacing.h"
 
 //#define INFINITY FLT_MAX
 
@@ -35,8 +36,12 @@ namespace d3d
 		D3DDEVTYPE deviceType,     // [in] HAL or REF
 		IDirect3DDevice9** device);// [out]The created device.
 
+	// ptr_display returns true while the scene is animating. When it returns
+	// false the loop stops drawing and sleeps until the next window message
+	// (or half a second, so changes made outside the window still show up).
 	int EnterMsgLoop( 
-		bool (*ptr_display)(float timeDelta));
+		bool (*ptr_display)(float timeDelta),
+		double targetFps = 60.0);  // [in] 0 means unlimited
 
 	LRESULT CALLBACK WndProc(
 		HWND hwnd,
@@ -65,6 +70,66 @@ namespace d3d
 		}
 	}
 
+	//
+	// Mesh optimization
+	//
+
+	// Vertex cache numbers of an indexed mesh. ACMR is the average number of
+	// vertices transformed per triangle with a FIFO post-transform cache of
+	// cacheSize entries: 0.5 is about the best a closed mesh can do, 3.0 means
+	// no vertex is ever reused.
+	struct MeshStats
+	{
+		DWORD faces;
+		DWORD vertices;
+		DWORD bytesPerVertex;
+		float acmr;
+	};
+
+	bool MeasureMesh(ID3DXMesh* mesh, MeshStats* stats, int cacheSize = 16);
+
+	// Sorts faces and vertices for the vertex cache. With a name, the numbers
+	// before and after go to the debugger output.
+	bool OptimizeMesh(ID3DXMesh* mesh, const char* name = 0);
+
+	//
+	// Frame pacing
+	//
+
+	// The QPC clock and Sleep() the game paces its frames with (see pacing.h)
+	double SystemClock(void);
+	void   SystemSleep(double sec);
+
+	//
+	// Tracing
+	//
+
+	// Begin/end events are recorded into a fixed pool of buffers and written
+	// as Chrome trace JSON (chrome://tracing, ui.perfetto.dev). A thread owns
+	// one buffer from its first event until it exits and only appends to that
+	// one, so recording takes no lock. Up to 8 threads record at the same time.
+	// When tracing is off an event costs a single branch.
+	extern volatile bool TracingOn;
+
+	void StartTracing(void);
+	bool StopTracing(const char* fileName);   // stops and writes the JSON file
+	void TraceEvent(const char* name, char phase);  // name must outlive the trace
+
+	struct TraceScope
+	{
+		TraceScope(const char* name) : _name(name), _on(TracingOn)
+		{
+			if( _on ) TraceEvent(_name, 'B');
+		}
+		~TraceScope()
+		{
+			if( _on ) TraceEvent(_name, 'E');
+		}
+
+		const char* _name;
+		bool        _on;
+	};
+
 	//
 	// Colors
 	//
@@ -120,6 +185,35 @@ namespace d3d
 		float       _radius;
 	};
 
+	// Bounding spheres kept as separate x/y/z/radius arrays, so the frustum
+	// test below runs over several of them per SIMD instruction.
+	struct SphereBatch
+	{
+		enum { CAPACITY = 512 };
+
+		SphereBatch();
+
+		int add(const D3DXVECTOR3& center, float radius);  // returns the index
+
+		float _x[CAPACITY];
+		float _y[CAPACITY];
+		float _z[CAPACITY];
+		float _radius[CAPACITY];
+		bool  _visible[CAPACITY];
+		int   _count;
+	};
+
+	struct Frustum
+	{
+		// planes of the space that viewProj maps to clip space
+		void build(const D3DXMATRIX& viewProj);
+
+		// fills batch._visible, returns the number of culled spheres
+		int cull(SphereBatch& batch) const;
+
+		D3DXPLANE _planes[6];
+	};
+
 	struct Ray
 	{
 		D3DXVECTOR3 _origin;
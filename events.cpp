@@ -0,0 +1,301 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: events.cpp
+//
+// Desc: Game event file, see events.h.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "events.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct EventWriter {
+    FILE* file;
+    EventBuffer queue[EVENT_QUEUE];
+    int head;               // oldest queued block
+    int count;              // queued blocks, the one being written included
+    bool stop;
+    std::mutex lock;
+    std::condition_variable ready;  // a block was queued, or stop was set
+    std::thread thread;
+    std::vector<unsigned char> column;
+};
+
+EventWriter* g_events = NULL;
+thread_local EventBuffer* t_events = NULL;
+std::atomic<unsigned int> g_sessionCount(0);
+std::atomic<unsigned int> g_eventsDropped(0);
+
+unsigned int newSession(void)
+{
+    return ++g_sessionCount;
+}
+
+EventBuffer* eventSink(EventBuffer* buffer)
+{
+    return g_events != NULL ? buffer : NULL;
+}
+
+void flushEvents(EventBuffer& buffer)
+{
+    if (NULL == g_events || buffer.count == 0) {
+        buffer.count = 0;
+        return;
+    }
+
+    std::lock_guard<std::mutex> hold(g_events->lock);
+    if (g_events->count == EVENT_QUEUE) {
+        // the writer is behind; a simulation thread must not wait for the disk
+        g_eventsDropped += (unsigned int)buffer.count;
+        buffer.count = 0;
+        return;
+    }
+    int slot = (g_events->head + g_events->count) % EVENT_QUEUE;
+    memcpy(&g_events->queue[slot], &buffer, sizeof(EventBuffer));
+    g_events->count++;
+    g_events->ready.notify_one();
+    buffer.count = 0;
+}
+
+void recordEvent(const SimState& state, int kind, int object)
+{
+    EventBuffer* events = t_events;
+    if (NULL == events)
+        return;
+
+    int n = events->count++;
+    events->session[n] = state.session;
+    events->tick[n] = state.tick;
+    events->kind[n] = (unsigned char)kind;
+    events->object[n] = (unsigned short)object;
+    events->x[n] = (int)floor(state.ball.x * EVENT_QUANT + 0.5f);
+    events->z[n] = (int)floor(state.ball.z * EVENT_QUANT + 0.5f);
+    if (events->count == EVENT_BLOCK)
+        flushEvents(*events);
+}
+
+void putVarint(std::vector<unsigned char>& out, unsigned int value)
+{
+    while (value >= 0x80) {
+        out.push_back((unsigned char)((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char)value);
+}
+
+void putDeltas(std::vector<unsigned char>& out, const int* values, int count)
+{
+    int previous = 0;
+    for (int i = 0; i < count; i++) {
+        int delta = values[i] - previous;
+        putVarint(out, ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31));
+        previous = values[i];
+    }
+}
+
+// column: byte length, then the bytes
+void writeColumn(EventWriter* writer)
+{
+    unsigned char length[5];
+    int n = 0;
+    unsigned int value = (unsigned int)writer->column.size();
+    while (value >= 0x80) {
+        length[n++] = (unsigned char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    length[n++] = (unsigned char)value;
+    fwrite(length, 1, n, writer->file);
+    if (!writer->column.empty())
+        fwrite(&writer->column[0], 1, writer->column.size(), writer->file);
+    writer->column.clear();
+}
+
+void writeEventBlock(EventWriter* writer, const EventBuffer& block)
+{
+    putVarint(writer->column, (unsigned int)block.count);
+    fwrite(&writer->column[0], 1, writer->column.size(), writer->file);
+    writer->column.clear();
+
+    putDeltas(writer->column, (const int*)block.session, block.count);
+    writeColumn(writer);
+    putDeltas(writer->column, (const int*)block.tick, block.count);
+    writeColumn(writer);
+    writer->column.insert(writer->column.end(), block.kind, block.kind + block.count);
+    writeColumn(writer);
+    for (int i = 0; i < block.count; i++)
+        putVarint(writer->column, block.object[i]);
+    writeColumn(writer);
+    putDeltas(writer->column, block.x, block.count);
+    writeColumn(writer);
+    putDeltas(writer->column, block.z, block.count);
+    writeColumn(writer);
+}
+
+void eventWriterThread(EventWriter* writer)
+{
+    std::unique_lock<std::mutex> hold(writer->lock);
+    for (;;) {
+        while (writer->count == 0 && !writer->stop)
+            writer->ready.wait(hold);
+        if (writer->count == 0)
+            break;
+
+        // producers only fill the slots after the queued ones, so this one is ours until count drops
+        int slot = writer->head;
+        hold.unlock();
+        writeEventBlock(writer, writer->queue[slot]);
+        hold.lock();
+
+        writer->head = (writer->head + 1) % EVENT_QUEUE;
+        writer->count--;
+    }
+}
+
+bool openEvents(const char* fileName)
+{
+    FILE* file = fopen(fileName, "wb");
+    if (NULL == file)
+        return false;
+    unsigned int magic = EVENT_MAGIC;
+    fwrite(&magic, sizeof(magic), 1, file);
+
+    EventWriter* writer = new EventWriter;
+    writer->file = file;
+    writer->head = 0;
+    writer->count = 0;
+    writer->stop = false;
+    g_eventsDropped = 0;
+    writer->column.reserve(EVENT_BLOCK * 5);   // so the writer never allocates
+    writer->thread = std::thread(eventWriterThread, writer);
+    g_events = writer;
+    return true;
+}
+
+void closeEvents(void)
+{
+    if (NULL == g_events)
+        return;
+
+    {
+        std::lock_guard<std::mutex> hold(g_events->lock);
+        g_events->stop = true;
+    }
+    g_events->ready.notify_one();
+    g_events->thread.join();
+    fclose(g_events->file);
+    delete g_events;
+    g_events = NULL;
+}
+
+bool eventsOpen(void)
+{
+    return g_events != NULL;
+}
+
+unsigned int eventsDropped(void)
+{
+    return g_eventsDropped;
+}
+
+bool getVarint(FILE* file, unsigned int* value)
+{
+    unsigned int result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int c = fgetc(file);
+        if (c == EOF)
+            return false;
+        result |= (unsigned int)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool takeVarint(const std::vector<unsigned char>& column, size_t* at, unsigned int* value)
+{
+    unsigned int result = 0;
+    for (int shift = 0; shift < 35 && *at < column.size(); shift += 7) {
+        unsigned char c = column[(*at)++];
+        result |= (unsigned int)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readColumn(FILE* file, std::vector<unsigned char>& column)
+{
+    unsigned int length;
+    if (!getVarint(file, &length) || length > EVENT_BLOCK * 5)
+        return false;
+    column.resize(length);
+    return length == 0 || fread(&column[0], 1, length, file) == length;
+}
+
+// the whole column must be count zigzag deltas
+bool takeDeltas(const std::vector<unsigned char>& column, int* values, int count)
+{
+    size_t at = 0;
+    unsigned int previous = 0;
+    for (int i = 0; i < count; i++) {
+        unsigned int raw;
+        if (!takeVarint(column, &at, &raw))
+            return false;
+        previous += (raw >> 1) ^ (0u - (raw & 1));
+        values[i] = (int)previous;
+    }
+    return at == column.size();
+}
+
+bool readEventHeader(FILE* file)
+{
+    unsigned int magic;
+    return fread(&magic, sizeof(magic), 1, file) == 1 && magic == EVENT_MAGIC;
+}
+
+bool readEventBlock(FILE* file, EventBuffer& block)
+{
+    std::vector<unsigned char> column;
+    unsigned int count;
+    block.count = 0;
+    if (!getVarint(file, &count) || count == 0 || count > EVENT_BLOCK)
+        return false;
+    int n = (int)count;
+
+    if (!readColumn(file, column) || !takeDeltas(column, (int*)block.session, n))
+        return false;
+    if (!readColumn(file, column) || !takeDeltas(column, (int*)block.tick, n))
+        return false;
+    if (!readColumn(file, column) || column.size() != count)
+        return false;
+    memcpy(block.kind, &column[0], count);
+    if (!readColumn(file, column))
+        return false;
+    size_t at = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned int object;
+        if (!takeVarint(column, &at, &object) || object > 0xffff)
+            return false;
+        block.object[i] = (unsigned short)object;
+    }
+    if (at != column.size())
+        return false;
+    if (!readColumn(file, column) || !takeDeltas(column, block.x, n))
+        return false;
+    if (!readColumn(file, column) || !takeDeltas(column, block.z, n))
+        return false;
+
+    block.count = n;
+    return true;
+}
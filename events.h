@@ -0,0 +1,82 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: events.h
+//
+// Desc: Records what happens in the games (launches, hits, bounces, destroyed bricks,
+//       lost balls) into a columnar file, written by a thread of its own, and reads
+//       the file back.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __eventsH__
+#define __eventsH__
+
+#include <cstdio>
+#include "simulation.h"
+
+// -----------------------------------------------------------------------------
+// Game events
+// simulate() reports launches, hits, bounces, destroyed bricks and lost balls
+// into the EventBuffer its thread was given (t_events), or nowhere when there
+// is none, e.g. for the shot solver. a full buffer is copied into the writer's
+// queue; the writer thread encodes it and appends it to the event file. the
+// file is columnar, each block of events is stored column by column:
+//     EVENT_MAGIC (32-bit)
+//     block: count, then per column (session, tick, kind, object, x, z):
+//            byte length, bytes
+// kind is one byte per event, object one varint. the other columns are zigzag
+// varint deltas from the previous event of the block, x and z in
+// 1/EVENT_QUANT units. when the writer falls EVENT_QUEUE blocks behind, a
+// flushed block is dropped rather than stalling the simulation; eventsDropped()
+// counts its events.
+// -----------------------------------------------------------------------------
+#define EVENT_MAGIC 0x32454c56      // "VLE2"
+#define EVENT_BLOCK 4096            // events per buffer and per file block
+#define EVENT_QUEUE 8               // blocks waiting for the writer
+#define EVENT_QUANT 512.0f
+
+enum { EVENT_LAUNCH, EVENT_HIT, EVENT_BRICK, EVENT_BOUNCE, EVENT_LOST };
+
+static_assert(MAX_BRICKS + WALL_COUNT + 2 <= 0x10000, "EventBuffer::object holds every object");
+
+struct EventBuffer {
+    unsigned int session[EVENT_BLOCK];
+    unsigned int tick[EVENT_BLOCK];
+    unsigned char kind[EVENT_BLOCK];
+    unsigned short object[EVENT_BLOCK]; // brick, wall (WALL_COUNT + 0/1 are the paddles)
+    int x[EVENT_BLOCK];                 // ball position
+    int z[EVENT_BLOCK];
+    int count;
+};
+
+// the buffer simulate() on this thread records into, NULL for none
+extern thread_local EventBuffer* t_events;
+
+unsigned int newSession(void);
+
+// returns buffer while an event file is open, NULL otherwise
+EventBuffer* eventSink(EventBuffer* buffer);
+
+// hands the events in buffer to the writer and empties it. never waits: the
+// events are dropped if the writer's queue is full.
+void flushEvents(EventBuffer& buffer);
+void recordEvent(const SimState& state, int kind, int object);
+
+bool openEvents(const char* fileName);
+bool eventsOpen(void);
+
+// waits for everything queued to be written and closes the file. every
+// owner of a buffer (the game, training environments) must flush it first.
+void closeEvents(void);
+
+// events flushed but not written because the queue was full, since the last
+// openEvents() (still readable after closeEvents())
+unsigned int eventsDropped(void);
+
+// reading an event file back: readEventHeader() checks EVENT_MAGIC, then each
+// readEventBlock() decodes the next block into block. both return false at
+// the end of the file or on data that is not a whole, valid block.
+bool readEventHeader(FILE* file);
+bool readEventBlock(FILE* file, EventBuffer& block);
+
+#endif // __eventsH__
@@ -0,0 +1,232 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoEnv.cpp
+//
+// Desc: Headless training environments, see legoEnv.h. Built into the game and, on its
+//       own with simulation.cpp and events.cpp, into LegoEnv.dll (LegoEnv.vcxproj).
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "legoEnv.h"
+#include "simulation.h"
+#include "events.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// -----------------------------------------------------------------------------
+// Training environments
+// every environment is one SimState stepped with the same simulate() as the
+// game, at a fixed 60 fps timeDelta. the environments of one LegoEnvs share
+// its level, read once when they are created, and the tuning, which no step
+// changes. LegoEnvStep() deals the environments out in contiguous ranges, one
+// per worker, and every worker writes straight into the caller's rows. the
+// workers are started by LegoEnvCreate() and sleep between steps; the calling
+// thread steps the first range itself.
+// -----------------------------------------------------------------------------
+#define ENV_STEP SIM_STEP
+#define ENV_MIN_PER_WORKER 64       // fewer are not worth a thread
+
+static_assert(LEGO_ENV_MAX_BRICKS == MAX_BRICKS, "legoEnv.h must match MAX_BRICKS");
+
+struct LegoEnvs {
+    Level level;
+    std::vector<SimState> states;
+    std::vector<int> bricksLeft;
+    std::vector<EventBuffer> events;    // one per worker
+
+    // the step the workers are asked to run
+    const LegoAction* actions;
+    float* observations;
+    float* rewards;
+    unsigned char* dones;
+
+    int workers;                        // the calling thread included
+    unsigned int step;                  // bumped for every step
+    int busy;                           // pool threads not done with the step yet
+    bool stop;
+    std::mutex lock;
+    std::condition_variable start;      // step was bumped, or stop was set
+    std::condition_variable done;       // busy dropped to 0
+    std::vector<std::thread> pool;      // workers 1 .. workers - 1
+};
+
+void writeObservation(const SimState& state, float* row)
+{
+    row[LEGO_ENV_OBS_BALL_X] = state.ball.x;
+    row[LEGO_ENV_OBS_BALL_Z] = state.ball.z;
+    row[LEGO_ENV_OBS_BALL_VX] = state.ball.vx;
+    row[LEGO_ENV_OBS_BALL_VZ] = state.ball.vz;
+    row[LEGO_ENV_OBS_PADDLE_X] = state.paddle.x;
+    row[LEGO_ENV_OBS_LAUNCHED] = state.started ? 1.0f : 0.0f;
+    for (int i = 0; i < MAX_BRICKS; i++)
+        row[LEGO_ENV_OBS_BRICKS + i] = brickAlive(state, i) ? 1.0f : 0.0f;
+}
+
+void resetEnv(LegoEnvs* envs, int e)
+{
+    SimState& state = envs->states[e];
+    resetState(envs->level, state);
+    state.session = newSession();
+    envs->bricksLeft[e] = countBricks(state);
+}
+
+// steps the environments of range worker out of envs->workers
+void stepEnvs(LegoEnvs* envs, int worker)
+{
+    int count = (int)envs->states.size();
+    int first = count * worker / envs->workers;
+    int last = count * (worker + 1) / envs->workers;
+
+    t_events = eventSink(&envs->events[worker]);
+    for (int e = first; e < last; e++) {
+        SimState& state = envs->states[e];
+        const LegoAction& action = envs->actions[e];
+        FrameInput input;
+        input.paddle_x = action.paddle_x < PADDLE_MIN_X ? PADDLE_MIN_X :
+            (action.paddle_x > PADDLE_MAX_X ? PADDLE_MAX_X : action.paddle_x);
+        input.launch = action.launch != 0;
+        applyInput(state, input);
+
+        bool wasStarted = state.started;
+        simulate(envs->level, state, ENV_STEP);
+
+        int left = countBricks(state);
+        bool lost = wasStarted && !state.started;
+        envs->rewards[e] = (float)(envs->bricksLeft[e] - left) - (lost ? 1.0f : 0.0f);
+        envs->dones[e] = (lost || left == 0) ? 1 : 0;
+        if (envs->dones[e])
+            resetEnv(envs, e);
+        else
+            envs->bricksLeft[e] = left;
+        writeObservation(state, envs->observations + (size_t)e * LEGO_ENV_OBS_SIZE);
+    }
+    t_events = NULL;
+}
+
+void envWorker(LegoEnvs* envs, int worker)
+{
+    unsigned int step = 0;
+    std::unique_lock<std::mutex> hold(envs->lock);
+    for (;;) {
+        while (envs->step == step && !envs->stop)
+            envs->start.wait(hold);
+        if (envs->stop)
+            break;
+        step = envs->step;
+
+        hold.unlock();
+        stepEnvs(envs, worker);
+        hold.lock();
+
+        if (--envs->busy == 0)
+            envs->done.notify_one();
+    }
+}
+
+LegoEnvs* LegoEnvCreate(int count, const char* levelFile)
+{
+    if (count <= 0)
+        return NULL;
+
+    LegoEnvs* envs = new LegoEnvs;
+    defaultLevel(envs->level);
+    if (levelFile != NULL) {
+        // a level cut down to MAX_BRICKS is not the one asked for
+        int listed = 0;
+        int bricks = readLevel(levelFile, envs->level.pos, &listed);
+        if (bricks < 0 || listed > bricks) {
+            delete envs;
+            return NULL;
+        }
+        envs->level.count = bricks;
+        buildChunks(envs->level);
+    }
+
+    int workers = (int)std::thread::hardware_concurrency();
+    if (workers > count / ENV_MIN_PER_WORKER)
+        workers = count / ENV_MIN_PER_WORKER;
+    if (workers < 1)
+        workers = 1;
+
+    envs->states.resize(count);
+    envs->bricksLeft.resize(count);
+    envs->events.resize(workers);
+    for (int e = 0; e < count; e++)
+        resetEnv(envs, e);
+
+    envs->workers = workers;
+    envs->step = 0;
+    envs->busy = 0;
+    envs->stop = false;
+    for (int w = 1; w < workers; w++)
+        envs->pool.push_back(std::thread(envWorker, envs, w));
+    return envs;
+}
+
+void LegoEnvDestroy(LegoEnvs* envs)
+{
+    if (NULL == envs)
+        return;
+
+    {
+        std::lock_guard<std::mutex> hold(envs->lock);
+        envs->stop = true;
+    }
+    envs->start.notify_all();
+    for (size_t t = 0; t < envs->pool.size(); t++)
+        envs->pool[t].join();
+
+    for (size_t w = 0; w < envs->events.size(); w++)
+        flushEvents(envs->events[w]);
+    delete envs;
+}
+
+void LegoEnvReset(LegoEnvs* envs, float* observations)
+{
+    for (size_t e = 0; e < envs->states.size(); e++) {
+        resetEnv(envs, (int)e);
+        writeObservation(envs->states[e], observations + e * LEGO_ENV_OBS_SIZE);
+    }
+}
+
+void LegoEnvStep(LegoEnvs* envs, const LegoAction* actions,
+    float* observations, float* rewards, unsigned char* dones)
+{
+    envs->actions = actions;
+    envs->observations = observations;
+    envs->rewards = rewards;
+    envs->dones = dones;
+    if (envs->workers == 1) {
+        stepEnvs(envs, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> hold(envs->lock);
+        envs->busy = envs->workers - 1;
+        envs->step++;
+    }
+    envs->start.notify_all();
+    stepEnvs(envs, 0);
+
+    std::unique_lock<std::mutex> hold(envs->lock);
+    while (envs->busy > 0)
+        envs->done.wait(hold);
+}
+
+int LegoEnvOpenEvents(const char* fileName)
+{
+    return (!eventsOpen() && openEvents(fileName)) ? 1 : 0;
+}
+
+void LegoEnvCloseEvents(void)
+{
+    closeEvents();
+}
+
+unsigned int LegoEnvEventsDropped(void)
+{
+    return eventsDropped();
+}
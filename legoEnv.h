@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: legoEnv.h
+//
+// Desc: C interface for running many games at once without a window, e.g. to train
+//       paddle agents. Every call steps all environments; actions are read from and
+//       observations and rewards written to caller buffers, one row per environment.
+//       A finished game (ball lost or no bricks left) starts over on its own.
+//       LegoEnv.vcxproj builds these functions into LegoEnv.dll (with LEGO_ENV_EXPORTS
+//       defined); the game compiles the same sources in for its -grid mode.
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoEnvH__
+#define __legoEnvH__
+
+#if defined(_WIN32) && defined(LEGO_ENV_EXPORTS)
+#define LEGO_ENV_API __declspec(dllexport)
+#else
+#define LEGO_ENV_API
+#endif
+
+#define LEGO_ENV_MAX_BRICKS 320
+
+// one observation row, all floats, at these offsets:
+#define LEGO_ENV_OBS_BALL_X    0
+#define LEGO_ENV_OBS_BALL_Z    1
+#define LEGO_ENV_OBS_BALL_VX   2
+#define LEGO_ENV_OBS_BALL_VZ   3
+#define LEGO_ENV_OBS_PADDLE_X  4
+#define LEGO_ENV_OBS_LAUNCHED  5       // 0 or 1
+#define LEGO_ENV_OBS_BRICKS    6       // alive (0/1) of brick 0 .. LEGO_ENV_MAX_BRICKS - 1
+#define LEGO_ENV_OBS_SIZE      (LEGO_ENV_OBS_BRICKS + LEGO_ENV_MAX_BRICKS)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct LegoEnvs LegoEnvs;
+
+typedef struct LegoAction
+{
+	float paddle_x;     // where to put the paddle, clamped to the table
+	int   launch;       // nonzero launches the ball if it is on the paddle
+} LegoAction;
+
+// levelFile may be NULL for the default level. returns NULL if it can't be read or
+// lists more than LEGO_ENV_MAX_BRICKS bricks.
+// LegoEnvDestroy(NULL) does nothing.
+LEGO_ENV_API LegoEnvs* LegoEnvCreate(int count, const char* levelFile);
+LEGO_ENV_API void      LegoEnvDestroy(LegoEnvs* envs);
+
+// observations: count * LEGO_ENV_OBS_SIZE floats
+LEGO_ENV_API void      LegoEnvReset(LegoEnvs* envs, float* observations);
+
+// rewards: count floats, +1 per brick destroyed and -1 for a lost ball
+// dones:   count bytes, 1 where the game ended this step (the observation is then
+//          already the first one of the next game)
+LEGO_ENV_API void      LegoEnvStep(LegoEnvs* envs, const LegoAction* actions,
+                                   float* observations, float* rewards, unsigned char* dones);
+
+// records the events of every game (launches, hits, bounces, destroyed bricks,
+// lost balls) into a columnar file, written in the background. returns 0 if the
+// file cannot be created or one is open already. destroy the environments
+// before closing, so their last events get in.
+LEGO_ENV_API int       LegoEnvOpenEvents(const char* fileName);
+LEGO_ENV_API void      LegoEnvCloseEvents(void);
+
+// events of the open (or last) event file that were dropped because the
+// writer fell behind; the environments never wait for it
+LEGO_ENV_API unsigned int LegoEnvEventsDropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __legoEnvH__
@@ -0,0 +1,478 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: netplay.cpp
+//
+// Desc: Lockstep versus over UDP, see netplay.h.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+#include "netplay.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cstddef>
+
+#define NET_MAGIC 0x3154454e        // "NET1"
+#define NET_QUANT 512.0f            // paddle positions are sent in 1/512 units
+#define NET_HASHES 8                // own hashes kept to compare with the other side's
+
+enum { NET_WANT_STATE = 1, NET_HAS_STATE = 2 };
+
+struct NetInput {
+    short paddle_x;
+    unsigned char launch;
+    unsigned char pad;
+};
+
+struct NetPacket {
+    unsigned int magic;
+    unsigned int flags;
+    unsigned int ack;               // the sender has every input of ours before this tick
+    unsigned int first;             // tick of inputs[0]
+    unsigned int count;
+    unsigned int hashTick;          // the sender's state hash after hashTick ticks, 0 = none yet
+    unsigned int hash;
+    double sentAt;                  // sender's clock
+    double echo;                    // sentAt of the newest packet the sender got from us, 0 = none
+    double echoAge;                 // how long before sending this the sender got it
+    NetInput inputs[NET_REDUNDANCY];
+    unsigned int stateTick;         // NET_HAS_STATE: the host's state after stateTick ticks
+    SimState state;
+};
+
+// a packet without the state ends here
+const int NET_SHORT_PACKET = (int)offsetof(NetPacket, stateTick);
+
+struct NetHeld {
+    double due;
+    double readAt;
+    int size;
+    NetPacket packet;
+};
+
+struct NetHash {
+    unsigned int tick;
+    unsigned int hash;
+};
+
+struct NetPeer {
+    SOCKET socket;
+    sockaddr_in remote;
+    bool connected;                 // remote is known and has sent something
+    int player;
+    d3d::ClockFn clock;
+
+    unsigned int tick;              // next tick to simulate
+    NetInput inputs[2][NET_HISTORY];
+    unsigned int known[2];          // inputs of player p are there for every tick before known[p]
+    unsigned int remoteAck;         // the other side has our inputs before this tick
+
+    NetHash hashes[NET_HASHES];
+    unsigned int remoteHashTick;
+    unsigned int remoteHash;
+    unsigned int checkedHashTick;   // remote hashes up to this tick were compared
+    bool wantState;                 // guest: waiting for the host's state
+    bool remoteWantsState;          // host: the guest asked for it
+
+    double echo;                    // sentAt of the newest packet from the other side
+    double echoAt;                  // when it arrived
+    double roundTrip;
+
+    double delay;                   // netSimulate()
+    double loss;
+    unsigned int random;
+    NetHeld held[NET_HELD];
+    int heldHead;
+    int heldCount;
+
+    unsigned int stalls;
+    unsigned int desyncs;
+    unsigned int resyncs;
+};
+
+NetInput packInput(const FrameInput& input)
+{
+    float x = input.paddle_x < PADDLE_MIN_X ? PADDLE_MIN_X :
+        (input.paddle_x > PADDLE_MAX_X ? PADDLE_MAX_X : input.paddle_x);
+    NetInput packed;
+    packed.paddle_x = (short)floor(x * NET_QUANT + 0.5f);
+    packed.launch = input.launch ? 1 : 0;
+    packed.pad = 0;
+    return packed;
+}
+
+FrameInput unpackInput(const NetInput& packed)
+{
+    FrameInput input;
+    input.paddle_x = packed.paddle_x / NET_QUANT;
+    input.launch = packed.launch != 0;
+    return input;
+}
+
+NetPeer* openPeer(int player, unsigned short port, d3d::ClockFn clock)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+        return NULL;
+#endif
+    SOCKET s = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s == INVALID_SOCKET) {
+#ifdef _WIN32
+        ::WSACleanup();
+#endif
+        return NULL;
+    }
+
+    sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(port);
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    bool ready = ::bind(s, (sockaddr*)&local, sizeof(local)) == 0 &&
+        ::ioctlsocket(s, FIONBIO, &nonBlocking) == 0;
+#else
+    bool ready = ::bind(s, (sockaddr*)&local, sizeof(local)) == 0 &&
+        ::fcntl(s, F_SETFL, ::fcntl(s, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+    if (!ready) {
+        closesocket(s);
+#ifdef _WIN32
+        ::WSACleanup();
+#endif
+        return NULL;
+    }
+
+    NetPeer* peer = new NetPeer;
+    memset(peer, 0, sizeof(NetPeer));
+    peer->socket = s;
+    peer->player = player;
+    peer->clock = clock;
+    peer->random = 12345;
+
+    // the first ticks run on empty inputs, so the first real ones can be sent ahead
+    FrameInput none = { 0.0f, false };
+    for (int p = 0; p < 2; p++) {
+        for (unsigned int t = 0; t < NET_INPUT_DELAY; t++)
+            peer->inputs[p][t] = packInput(none);
+        peer->known[p] = NET_INPUT_DELAY;
+    }
+    return peer;
+}
+
+NetPeer* netHost(unsigned short port, d3d::ClockFn clock)
+{
+    return openPeer(0, port, clock);
+}
+
+NetPeer* netJoin(const char* address, d3d::ClockFn clock)
+{
+    char host[256];
+    const char* colon = strrchr(address, ':');
+    if (NULL == colon || colon == address || (size_t)(colon - address) >= sizeof(host))
+        return NULL;
+    memcpy(host, address, colon - address);
+    host[colon - address] = '\0';
+
+    NetPeer* peer = openPeer(1, 0, clock);
+    if (NULL == peer)
+        return NULL;
+
+    addrinfo hints;
+    addrinfo* found = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (::getaddrinfo(host, colon + 1, &hints, &found) != 0 || NULL == found) {
+        netClose(peer);
+        return NULL;
+    }
+    memcpy(&peer->remote, found->ai_addr, sizeof(peer->remote));
+    ::freeaddrinfo(found);
+    return peer;
+}
+
+void netClose(NetPeer* peer)
+{
+    if (NULL == peer)
+        return;
+    closesocket(peer->socket);
+#ifdef _WIN32
+    ::WSACleanup();
+#endif
+    delete peer;
+}
+
+void netSimulate(NetPeer* peer, double delay, double loss)
+{
+    peer->delay = delay > 0 ? delay : 0;
+    peer->loss = loss > 0 ? loss : 0;
+}
+
+// -----------------------------------------------------------------------------
+// Receiving
+// -----------------------------------------------------------------------------
+
+// uniform in [0, 1), for the simulated loss
+double nextRandom(NetPeer* peer)
+{
+    peer->random = peer->random * 1103515245u + 12345u;
+    return ((peer->random >> 16) & 0x7fff) / 32768.0;
+}
+
+void recordHash(NetPeer* peer, const SimState& state)
+{
+    NetHash& slot = peer->hashes[(peer->tick / NET_HASH_INTERVAL) % NET_HASHES];
+    slot.tick = peer->tick;
+    slot.hash = hashState(state);
+}
+
+// compares the other side's latest hash with ours for the same tick, if we still have it
+void checkHash(NetPeer* peer)
+{
+    if (peer->remoteHashTick <= peer->checkedHashTick || peer->remoteHashTick > peer->tick)
+        return;
+    peer->checkedHashTick = peer->remoteHashTick;
+    const NetHash& slot = peer->hashes[(peer->remoteHashTick / NET_HASH_INTERVAL) % NET_HASHES];
+    if (slot.tick != peer->remoteHashTick || slot.hash == peer->remoteHash)
+        return;
+
+    peer->desyncs++;
+    if (peer->player == 1)
+        peer->wantState = true;
+}
+
+void receivePacket(NetPeer* peer, const NetPacket& packet, int size, double receivedAt, SimState& state)
+{
+    peer->connected = true;
+    if (packet.ack > peer->remoteAck)
+        peer->remoteAck = packet.ack;
+
+    // the inputs continue where ours end, or overlap them
+    int remote = 1 - peer->player;
+    unsigned int count = packet.count < NET_REDUNDANCY ? packet.count : NET_REDUNDANCY;
+    for (unsigned int k = 0; k < count; k++) {
+        unsigned int t = packet.first + k;
+        if (t == peer->known[remote] && t < peer->tick + NET_HISTORY) {
+            peer->inputs[remote][t % NET_HISTORY] = packet.inputs[k];
+            peer->known[remote] = t + 1;
+        }
+    }
+
+    if (packet.sentAt > peer->echo) {
+        peer->echo = packet.sentAt;
+        peer->echoAt = receivedAt;
+    }
+    if (packet.echo > 0) {
+        double sample = receivedAt - packet.echo - packet.echoAge;
+        peer->roundTrip = peer->roundTrip == 0 ? sample : peer->roundTrip + (sample - peer->roundTrip) / 8;
+    }
+
+    peer->remoteWantsState = (packet.flags & NET_WANT_STATE) != 0;
+    if (peer->wantState && (packet.flags & NET_HAS_STATE) && size >= (int)sizeof(NetPacket)) {
+        // resync: the host's state replaces ours, the ticks we ran past it run again
+        unsigned int session = state.session;
+        state = packet.state;
+        state.session = session;
+        peer->tick = packet.stateTick;
+        memset(peer->hashes, 0, sizeof(peer->hashes));
+        peer->wantState = false;
+        peer->resyncs++;
+    }
+
+    if (packet.hashTick > peer->remoteHashTick) {
+        peer->remoteHashTick = packet.hashTick;
+        peer->remoteHash = packet.hash;
+    }
+    checkHash(peer);
+}
+
+void netPoll(NetPeer* peer, SimState& state)
+{
+    double now = peer->clock();
+
+    // everything that arrived goes through the held queue, delayed or not
+    for (;;) {
+        NetHeld& held = peer->held[(peer->heldHead + peer->heldCount) % NET_HELD];
+        sockaddr_in from;
+        socklen_t fromSize = sizeof(from);
+        int size = (int)::recvfrom(peer->socket, (char*)&held.packet, sizeof(NetPacket), 0,
+            (sockaddr*)&from, &fromSize);
+        if (size < 0) {
+#ifdef _WIN32
+            // an ICMP port unreachable for an earlier send, the guest may not be up yet
+            if (::WSAGetLastError() == WSAECONNRESET)
+                continue;
+#endif
+            break;
+        }
+        if (size < NET_SHORT_PACKET || held.packet.magic != NET_MAGIC)
+            continue;
+
+        // the host takes the first peer it hears from as the guest
+        if (peer->player == 0 && !peer->connected)
+            peer->remote = from;
+        else if (from.sin_addr.s_addr != peer->remote.sin_addr.s_addr || from.sin_port != peer->remote.sin_port)
+            continue;
+
+        if (peer->loss > 0 && nextRandom(peer) < peer->loss)
+            continue;
+        if (peer->heldCount == NET_HELD)
+            continue;
+        held.size = size;
+        held.readAt = now;
+        held.due = peer->delay > 0 ? held.packet.sentAt + peer->delay : now;
+        peer->heldCount++;
+    }
+
+    while (peer->heldCount > 0) {
+        NetHeld& held = peer->held[peer->heldHead];
+        if (held.due > now)
+            break;
+        // a delayed packet counts as arrived when it was due
+        double receivedAt = peer->delay > 0 ? held.due : held.readAt;
+        receivePacket(peer, held.packet, held.size, receivedAt, state);
+        peer->heldHead = (peer->heldHead + 1) % NET_HELD;
+        peer->heldCount--;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Stepping and sending
+// -----------------------------------------------------------------------------
+bool netQueueInput(NetPeer* peer, const FrameInput& input)
+{
+    unsigned int due = peer->tick + NET_INPUT_DELAY;
+    unsigned int& known = peer->known[peer->player];
+    if (known > due)
+        return false;
+
+    // after a resync the ticks up to due may have none yet
+    NetInput packed = packInput(input);
+    while (known <= due) {
+        peer->inputs[peer->player][known % NET_HISTORY] = packed;
+        known++;
+    }
+    return true;
+}
+
+bool netStep(NetPeer* peer, const Level& level, SimState& state)
+{
+    unsigned int t = peer->tick;
+    if (peer->known[0] <= t || peer->known[1] <= t) {
+        peer->stalls++;
+        return false;
+    }
+
+    FrameInput inputs[2];
+    inputs[0] = unpackInput(peer->inputs[0][t % NET_HISTORY]);
+    inputs[1] = unpackInput(peer->inputs[1][t % NET_HISTORY]);
+    applyInputs(state, inputs);
+    simulate(level, state, SIM_STEP);
+
+    peer->tick = t + 1;
+    if (peer->tick % NET_HASH_INTERVAL == 0) {
+        recordHash(peer, state);
+        checkHash(peer);
+    }
+    return true;
+}
+
+void netSend(NetPeer* peer, const SimState& state)
+{
+    if (peer->player == 0 && !peer->connected)
+        return;
+
+    NetPacket packet;
+    double now = peer->clock();
+    int local = peer->player;
+    unsigned int first = peer->remoteAck;
+
+    packet.magic = NET_MAGIC;
+    packet.flags = peer->wantState ? NET_WANT_STATE : 0;
+    packet.ack = peer->known[1 - local];
+    packet.first = first;
+    packet.count = peer->known[local] - first;
+    if (packet.count > NET_REDUNDANCY)
+        packet.count = NET_REDUNDANCY;
+    for (unsigned int k = 0; k < packet.count; k++)
+        packet.inputs[k] = peer->inputs[local][(first + k) % NET_HISTORY];
+    memset(packet.inputs + packet.count, 0, sizeof(NetInput) * (NET_REDUNDANCY - packet.count));
+
+    const NetHash& latest = peer->hashes[(peer->tick / NET_HASH_INTERVAL) % NET_HASHES];
+    packet.hashTick = latest.tick;
+    packet.hash = latest.hash;
+
+    packet.sentAt = now;
+    packet.echo = peer->echo;
+    packet.echoAge = peer->echo > 0 ? now - peer->echoAt : 0;
+
+    int size = NET_SHORT_PACKET;
+    if (peer->player == 0 && peer->remoteWantsState) {
+        packet.flags |= NET_HAS_STATE;
+        packet.stateTick = peer->tick;
+        packet.state = state;
+        size = sizeof(NetPacket);
+    }
+    ::sendto(peer->socket, (const char*)&packet, size, 0, (const sockaddr*)&peer->remote, sizeof(peer->remote));
+}
+
+// -----------------------------------------------------------------------------
+// Status
+// -----------------------------------------------------------------------------
+int netPlayer(const NetPeer* peer)
+{
+    return peer->player;
+}
+
+bool netConnected(const NetPeer* peer)
+{
+    return peer->connected;
+}
+
+unsigned int netTick(const NetPeer* peer)
+{
+    return peer->tick;
+}
+
+double netRoundTrip(const NetPeer* peer)
+{
+    return peer->roundTrip;
+}
+
+unsigned int netStalls(const NetPeer* peer)
+{
+    return peer->stalls;
+}
+
+unsigned int netDesyncs(const NetPeer* peer)
+{
+    return peer->desyncs;
+}
+
+unsigned int netResyncs(const NetPeer* peer)
+{
+    return peer->resyncs;
+}
+
+bool netLatencyOk(const NetPeer* peer)
+{
+    return peer->roundTrip / 2 <= NET_INPUT_DELAY * NET_TICK_SECONDS;
+}
@@ -0,0 +1,84 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: netplay.h
+//
+// Desc: Two-player versus over UDP in lockstep. The peers only exchange what their
+//       players asked for (FrameInput) and run the same simulation on both sides; the
+//       host is player 0, the guest player 1. Both need the same level and tuning.
+//       Nothing in here touches Direct3D, so it builds and runs anywhere
+//       (tests/netplayTest.cpp plays two peers over loopback).
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __netplayH__
+#define __netplayH__
+
+#include "simulation.h"
+#include "pacing.h"
+
+// -----------------------------------------------------------------------------
+// Lockstep
+// an input is sampled for the tick NET_INPUT_DELAY ticks ahead and sent at once,
+// so at 60 ticks per second the other side has about 33ms to get it before it
+// is due: any one-way latency below that keeps both simulations running
+// without a stall, at two frames from input to simulation. a tick only runs
+// once the inputs of both players for it are there.
+//
+// every packet repeats the inputs the other side has not acknowledged yet
+// (up to NET_REDUNDANCY), so a lost packet costs nothing but a later one. every
+// NET_HASH_INTERVAL ticks both sides hash their state (hashState()) and send it
+// along; a guest whose hash differs asks for the host's state and takes it
+// over (a resync). packets also echo the send time of the last one received,
+// which gives the round trip time.
+//
+// netSimulate() holds incoming packets back and drops some of them, to try
+// latency and loss over loopback. it times packets by the sender's clock, so
+// both sides must run on one machine.
+// -----------------------------------------------------------------------------
+#define NET_INPUT_DELAY 2           // ticks from sampling an input to simulating it
+#define NET_TICK_SECONDS (1.0 / 60.0)
+#define NET_REDUNDANCY 16           // inputs repeated in every packet
+#define NET_HASH_INTERVAL 30        // ticks between state hashes
+#define NET_HISTORY 128             // ticks of inputs kept
+#define NET_HELD 256                // packets netSimulate() can hold back
+
+struct NetPeer;
+
+// listen on port for a guest, or join the host at address ("name:port").
+// returns NULL if the socket can't be set up.
+NetPeer* netHost(unsigned short port, d3d::ClockFn clock);
+NetPeer* netJoin(const char* address, d3d::ClockFn clock);
+void netClose(NetPeer* peer);
+
+// delay and drop incoming packets: delay in seconds, loss from 0 to 1
+void netSimulate(NetPeer* peer, double delay, double loss);
+
+// once per frame: netPoll(), then for every tick due netQueueInput() and
+// netStep() until netStep() returns false, then netSend().
+
+// reads the packets that arrived. a resync replaces state.
+void netPoll(NetPeer* peer, SimState& state);
+
+// samples the local player's input for the tick NET_INPUT_DELAY ahead. returns
+// false if that tick has its input already (the step before stalled).
+bool netQueueInput(NetPeer* peer, const FrameInput& input);
+
+// runs the next tick on state if both inputs for it are there
+bool netStep(NetPeer* peer, const Level& level, SimState& state);
+
+// sends the local inputs the other side is missing, and the host's state if a
+// resync was asked for
+void netSend(NetPeer* peer, const SimState& state);
+
+int netPlayer(const NetPeer* peer);             // 0 host, 1 guest
+bool netConnected(const NetPeer* peer);         // heard from the other side
+unsigned int netTick(const NetPeer* peer);      // ticks simulated
+double netRoundTrip(const NetPeer* peer);       // seconds, 0 before the first echo
+unsigned int netStalls(const NetPeer* peer);    // netStep() calls that had to wait
+unsigned int netDesyncs(const NetPeer* peer);   // hashes that did not match
+unsigned int netResyncs(const NetPeer* peer);   // states taken over from the host
+
+// true while the one-way latency fits into the input delay
+bool netLatencyOk(const NetPeer* peer);
+
+#endif // __netplayH__
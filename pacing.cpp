@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: pacing.cpp
+//
+// Desc: Frame pacing and quality selection, see pacing.h.
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "pacing.h"
+
+d3d::FramePacer::FramePacer(double targetFps, ClockFn clock, SleepFn sleep)
+{
+	_clock = clock;
+	_sleep = sleep;
+	_spin  = 0.002;
+	setTargetFps(targetFps);
+	reset();
+}
+
+void d3d::FramePacer::setTargetFps(double fps)
+{
+	_period = (fps > 0.0) ? 1.0 / fps : 0.0;
+}
+
+void d3d::FramePacer::setSpinMargin(double sec)
+{
+	_spin = sec;
+}
+
+void d3d::FramePacer::reset(void)
+{
+	_last = _clock();
+	_next = _last;
+}
+
+double d3d::FramePacer::waitNextFrame(void)
+{
+	double now = _clock();
+	if( _next - now > _spin )
+		_sleep(_next - now - _spin);
+
+	now = _clock();
+	while( now < _next )
+		now = _clock();
+
+	double elapsed = now - _last;
+	_last = now;
+
+	// schedule from the deadline so the error does not add up,
+	// but don't try to catch up after a long stall
+	_next += _period;
+	if( _next < now )
+		_next = now + _period;
+
+	return elapsed;
+}
+
+d3d::QualityGovernor::QualityGovernor(int levels, double budgetMs)
+{
+	_levels = 1;
+	_level  = 0;
+	_budget = budgetMs;
+	setLevels(levels);
+	reset(_levels - 1);
+}
+
+void d3d::QualityGovernor::setLevels(int levels)
+{
+	_levels = (levels > 0) ? levels : 1;
+	if( _level >= _levels )
+		_level = _levels - 1;
+}
+
+void d3d::QualityGovernor::setBudget(double ms)
+{
+	_budget = ms;
+}
+
+void d3d::QualityGovernor::reset(int level)
+{
+	_level   = (level < 0) ? 0 : (level >= _levels ? _levels - 1 : level);
+	_average = 0.0;
+	_over    = 0;
+	_under   = 0;
+	_hold    = GOVERNOR_HOLD;
+}
+
+int d3d::QualityGovernor::update(double frameMs)
+{
+	if( _average == 0.0 )
+		_average = frameMs;
+	else
+		_average += (frameMs - _average) * GOVERNOR_SMOOTHING;
+
+	_over  = (_average > _budget * GOVERNOR_HIGH) ? _over + 1 : 0;
+	_under = (_average < _budget * GOVERNOR_LOW) ? _under + 1 : 0;
+
+	if( _hold > 0 )
+	{
+		_hold--;
+		return _level;
+	}
+
+	int next = _level;
+	if( _over >= GOVERNOR_DOWN_AFTER && _level > 0 )
+		next = _level - 1;
+	else if( _under >= GOVERNOR_UP_AFTER && _level < _levels - 1 )
+		next = _level + 1;
+
+	if( next != _level )
+	{
+		// the old average was measured at the old level
+		_level   = next;
+		_average = 0.0;
+		_over    = 0;
+		_under   = 0;
+		_hold    = GOVERNOR_HOLD;
+	}
+	return _level;
+}
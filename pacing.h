@@ -0,0 +1,78 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: pacing.h
+//
+// Desc: Frame pacing and quality selection. Nothing in here touches Windows or Direct3D:
+//       time comes in through the clock and sleep functions the caller passes, and
+//       quality only from the frame times it is fed. So both build and run anywhere,
+//       with fake clocks in the tests (tests/pacingTest.cpp).
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __pacingH__
+#define __pacingH__
+
+namespace d3d
+{
+	typedef double (*ClockFn)(void);        // current time in seconds, monotonic
+	typedef void   (*SleepFn)(double sec);  // block for about sec seconds
+
+	// Keeps frames at a target rate: sleeps coarsely until shortly before the
+	// deadline and spins the rest for precision.
+	class FramePacer
+	{
+	public:
+		FramePacer(double targetFps, ClockFn clock, SleepFn sleep);
+
+		void   setTargetFps(double fps);       // 0 means unlimited
+		void   setSpinMargin(double sec);      // time spent spinning instead of sleeping
+		void   reset(void);                    // restart timing, the next frame is due at once
+		double waitNextFrame(void);            // returns seconds since the previous frame
+
+	private:
+		ClockFn _clock;
+		SleepFn _sleep;
+		double  _period;
+		double  _spin;
+		double  _last;
+		double  _next;
+	};
+
+	// QualityGovernor tuning, shared with the tests
+	const double GOVERNOR_SMOOTHING  = 0.1;    // weight of the newest frame
+	const double GOVERNOR_HIGH       = 0.9;    // over this part of the budget is too slow
+	const double GOVERNOR_LOW        = 0.5;    // under this part there is room to spare
+	const int    GOVERNOR_DOWN_AFTER = 15;     // frames
+	const int    GOVERNOR_UP_AFTER   = 120;
+	const int    GOVERNOR_HOLD       = 60;
+
+	// Picks a quality level from measured frame times. The game maps the level
+	// to its own knobs (0 is the cheapest). It only looks at the numbers it is
+	// fed, so a recorded or made-up frame-time trace shows how it settles.
+	// Hysteresis: the level drops after the smoothed time stays over budget for
+	// a while, rises only after a longer stretch well under budget, and does
+	// nothing for a few frames after each change.
+	class QualityGovernor
+	{
+	public:
+		QualityGovernor(int levels = 4, double budgetMs = 1000.0 / 60.0);
+
+		void setLevels(int levels);            // keeps the current level if valid
+		void setBudget(double ms);             // frame time to stay under
+		void reset(int level);
+		int  update(double frameMs);           // returns the level to use now
+		int  level(void) const { return _level; }
+		double average(void) const { return _average; }
+
+	private:
+		int    _levels;
+		int    _level;
+		double _budget;
+		double _average;    // smoothed frame time
+		int    _over;       // frames in a row over budget
+		int    _under;      // frames in a row well under budget
+		int    _hold;       // frames left before the next change
+	};
+}
+
+#endif // __pacingH__
@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particles.cpp
+//
+// Desc: Particle pool, see particles.h.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "particles.h"
+#include <cstdlib>
+#include <cmath>
+
+ParticlePool::ParticlePool(void)
+{
+    m_count = 0;
+    m_limit = CAPACITY;
+}
+
+void ParticlePool::emit(float x, float y, float z, int count, float speed, float life, unsigned int color)
+{
+    if (count > m_limit - m_count)
+        count = m_limit - m_count;
+    for (int i = 0; i < count; i++) {
+        int k = m_count++;
+        float angle = 6.2831853f * rand() / RAND_MAX;
+        float s = speed * rand() / RAND_MAX;
+        m_x[k] = x; m_y[k] = y; m_z[k] = z;
+        m_vx[k] = s * cosf(angle);
+        m_vy[k] = speed * (0.5f + 0.5f * rand() / RAND_MAX);
+        m_vz[k] = s * sinf(angle);
+        m_life[k] = life * (0.5f + 0.5f * rand() / RAND_MAX);
+        m_color[k] = color;
+    }
+}
+
+void ParticlePool::update(float t)
+{
+    const int n = m_count;
+    int i;
+
+    // no branches in these loops, one lane per particle
+    for (i = 0; i < n; i++) {
+        m_vy[i] -= PARTICLE_GRAVITY * t;
+        m_x[i] += m_vx[i] * t;
+        m_y[i] += m_vy[i] * t;
+        m_z[i] += m_vz[i] * t;
+        m_life[i] -= t;
+    }
+    for (i = 0; i < n; i++) {
+        float below = m_y[i] < 0.0f ? 1.0f : 0.0f;
+        m_vy[i] -= below * (1.0f + PARTICLE_BOUNCE) * m_vy[i];
+        m_y[i] -= below * m_y[i];
+    }
+
+    // remove dead particles by moving the last one into their slot
+    i = 0;
+    while (i < m_count) {
+        if (m_life[i] > 0.0f) {
+            i++;
+            continue;
+        }
+        int last = --m_count;
+        m_x[i] = m_x[last]; m_y[i] = m_y[last]; m_z[i] = m_z[last];
+        m_vx[i] = m_vx[last]; m_vy[i] = m_vy[last]; m_vz[i] = m_vz[last];
+        m_life[i] = m_life[last];
+        m_color[i] = m_color[last];
+    }
+}
+
+void ParticlePool::setLimit(int limit)
+{
+    m_limit = limit < 0 ? 0 : (limit > CAPACITY ? CAPACITY : limit);
+    if (m_count > m_limit)
+        m_count = m_limit;
+}
@@ -0,0 +1,61 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particles.h
+//
+// Desc: The particle pool behind the debris and sparks of destroyed bricks: emitting,
+//       moving and retiring particles. Nothing in here touches Windows or Direct3D; the
+//       game only copies the positions into a vertex buffer (CParticles in
+//       virtualLego.cpp). Checked and timed by tests/particlesTest.cpp.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __particlesH__
+#define __particlesH__
+
+#define PARTICLE_GRAVITY    2.0f
+#define PARTICLE_BOUNCE     0.4f    // part of the vertical speed kept on the floor
+
+// -----------------------------------------------------------------------------
+// Particle pool
+// every particle field has its own fixed array (x[], y[], vx[], ...) so
+// update() is a few straight loops the compiler turns into SIMD code, and
+// nothing is allocated while playing. the live particles are the first
+// getCount() entries of every array.
+// -----------------------------------------------------------------------------
+class ParticlePool {
+public:
+    enum { CAPACITY = 500000 };
+
+    ParticlePool(void);
+
+    // spawn count particles at (x, y, z). they fly upward and outward with up
+    // to speed. when the pool is full the rest of the burst is dropped.
+    void emit(float x, float y, float z, int count, float speed, float life, unsigned int color);
+
+    // move every particle by time, in the units of its velocity (timeDelta *
+    // time_scale in the game), bounce it off the floor at y = 0 and retire
+    // the ones whose life ran out
+    void update(float time);
+
+    void clear(void) { m_count = 0; }
+    int getCount(void) const { return m_count; }
+    // cap the number of live particles (at most CAPACITY)
+    void setLimit(int limit);
+    int getLimit(void) const { return m_limit; }
+
+    const float* getX(void) const { return m_x; }
+    const float* getY(void) const { return m_y; }
+    const float* getZ(void) const { return m_z; }
+    const float* getVY(void) const { return m_vy; }
+    const unsigned int* getColor(void) const { return m_color; }     // D3DCOLOR
+
+private:
+    float        m_x[CAPACITY], m_y[CAPACITY], m_z[CAPACITY];
+    float        m_vx[CAPACITY], m_vy[CAPACITY], m_vz[CAPACITY];
+    float        m_life[CAPACITY];
+    unsigned int m_color[CAPACITY];
+    int          m_count;
+    int          m_limit;
+};
+
+#endif // __particlesH__
@@ -0,0 +1,555 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simulation.cpp
+//
+// Desc: The level, the ball physics and one step of play, see simulation.h.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simulation.h"
+#include "events.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+// default brick layout, replaced by the -level file if there is one. every brick is yellow.
+const float spherePos[6][2] = { {-2.0f, 0} , {0.0f,0} , {2.0f,0}, {-2.3f, 1.0f}, {0.0f, 1.0f}, {2.3f, 1.0f} };
+
+Tuning g_tuning = { (float)M_RADIUS, 3.3f, 2.0f, 0.0f };
+
+// -----------------------------------------------------------------------------
+// Table layout
+// -----------------------------------------------------------------------------
+const WallLayout WALL_LAYOUT[WALL_COUNT] = {
+    { 6.6f, 0.3f, 0.12f, 0.0f, 0.12f, 4.5f, 0 },    //     &    
+    { 0.12f, 0.3f, 9, 3.24f, 0.12f, 0.0f, 2 },      //    
+    { 0.12f, 0.3f, 9, -3.24f, 0.12f, 0.0f, 3 },     //    
+};
+
+// -----------------------------------------------------------------------------
+// Level
+// -----------------------------------------------------------------------------
+int chunkOf(float z)
+{
+    int c = (int)floor((z - TABLE_NEAR_Z) / CHUNK_DEPTH);
+    if (c < 0)
+        return 0;
+    if (c >= CHUNK_COUNT)
+        return CHUNK_COUNT - 1;
+    return c;
+}
+
+// sort the bricks of the level into their strips (counting sort)
+void buildChunks(Level& level)
+{
+    int count[CHUNK_COUNT] = { 0 };
+    int i, c;
+
+    for (i = 0; i < level.count; i++)
+        count[chunkOf(level.pos[i][1])]++;
+
+    level.chunkStart[0] = 0;
+    for (c = 0; c < CHUNK_COUNT; c++) {
+        level.chunkStart[c + 1] = level.chunkStart[c] + count[c];
+        count[c] = level.chunkStart[c];
+    }
+    for (i = 0; i < level.count; i++)
+        level.chunkBricks[count[chunkOf(level.pos[i][1])]++] = i;
+}
+
+unsigned int hashLevel(const Level& level)
+{
+    unsigned int hash = 2166136261u;
+    const unsigned char* bytes = (const unsigned char*)&level.count;
+    for (size_t k = 0; k < sizeof(level.count); k++) {
+        hash ^= bytes[k];
+        hash *= 16777619u;
+    }
+    bytes = (const unsigned char*)level.pos;
+    for (size_t k = 0; k < level.count * sizeof(level.pos[0]); k++) {
+        hash ^= bytes[k];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void defaultLevel(Level& level)
+{
+    memcpy(level.pos, spherePos, sizeof(spherePos));
+    level.count = sizeof(spherePos) / sizeof(spherePos[0]);
+    buildChunks(level);
+}
+
+int readLevel(const char* fileName, float pos[MAX_BRICKS][2], int* listed)
+{
+    FILE* file = fopen(fileName, "r");
+    if (NULL == file)
+        return -1;
+
+    // the bricks past MAX_BRICKS are only counted
+    char line[256];
+    float x, z;
+    int count = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || sscanf(line, "%f %f", &x, &z) != 2)
+            continue;
+        if (count < MAX_BRICKS) {
+            pos[count][0] = x;
+            pos[count][1] = z;
+        }
+        count++;
+    }
+    fclose(file);
+    *listed = count;
+    return count < MAX_BRICKS ? count : MAX_BRICKS;
+}
+
+// -----------------------------------------------------------------------------
+// Simulation state
+// -----------------------------------------------------------------------------
+bool brickAlive(const SimState& state, int brick)
+{
+    return (state.alive[brick / 32] & (1u << (brick % 32))) != 0;
+}
+
+void setBrickAlive(SimState& state, int brick, bool alive)
+{
+    unsigned int bit = 1u << (brick % 32);
+    if (alive)
+        state.alive[brick / 32] |= bit;
+    else
+        state.alive[brick / 32] &= ~bit;
+}
+
+int countBricks(const SimState& state)
+{
+    int count = 0;
+    for (int w = 0; w < ALIVE_WORDS; w++) {
+        for (unsigned int bits = state.alive[w]; bits != 0; bits &= bits - 1)
+            count++;
+    }
+    return count;
+}
+
+// -----------------------------------------------------------------------------
+// Ball physics
+// plain functions on BallState. every ball has the radius g_tuning.radius.
+// -----------------------------------------------------------------------------
+
+// true if ball overlaps a ball standing at (x, z)
+bool ballsTouch(float x, float z, const BallState& ball)
+{
+    double dx = ball.x - x;
+    double dz = ball.z - z;
+    return sqrt(dx * dx + dz * dz) < 2 * g_tuning.radius;
+}
+
+// moves the ball back halfway to where it was before its last move, or all the
+// way back with all = true. a collision takes it back halfway, and all the way
+// if it still overlaps there.
+void moveBack(BallState& ball, bool all)
+{
+    if (all) {
+        ball.x = ball.pre_x;
+        ball.z = ball.pre_z;
+    }
+    else {
+        ball.x = (ball.x + ball.pre_x) / 2;
+        ball.z = (ball.z + ball.pre_z) / 2;
+    }
+}
+
+// the ball bounces off a ball standing at (x, z): it leaves straight away from
+// that ball's center at the speed it came with. returns true if they touched.
+bool bounceOffBall(float x, float z, BallState& ball)
+{
+    if (!ballsTouch(x, z, ball))
+        return false;
+    moveBack(ball, false);
+    if (ballsTouch(x, z, ball))
+        moveBack(ball, true);
+
+    float dx = ball.x - x;
+    float dz = ball.z - z;
+    float distance = sqrt(dx * dx + dz * dz);
+    float velocity = sqrt(ball.vx * ball.vx + ball.vz * ball.vz);
+    float dt = velocity / distance;
+    ball.vx = dx * dt;
+    ball.vz = dz * dt;
+    return true;
+}
+
+bool wallTouches(const WallLayout& wall, const BallState& ball)
+{
+    float r = g_tuning.radius;
+    if (wall.side == 0)
+        return ball.z + r > wall.z - wall.depth / 2;
+    if (wall.side == 2)
+        return ball.x + r > wall.x - wall.width / 2;
+    if (wall.side == 3)
+        return ball.x - r < wall.x + wall.width / 2;
+    return false;
+}
+
+// reflects the ball off the wall. returns true if it touched the wall.
+bool bounceOffWall(const WallLayout& wall, BallState& ball)
+{
+    if (!wallTouches(wall, ball))
+        return false;
+    moveBack(ball, false);
+    if (wallTouches(wall, ball))
+        moveBack(ball, true);
+
+    if (wall.side == 0)     // far wall
+        ball.vz = -ball.vz;
+    else                    // side walls
+        ball.vx = -ball.vx;
+    return true;
+}
+
+double timeToStop(const BallState& ball, double damping)
+{
+    double speed = fabs(ball.vx) > fabs(ball.vz) ? fabs(ball.vx) : fabs(ball.vz);
+    if (damping <= 0)
+        return FLT_MAX;
+    if (speed <= STOP_SPEED)
+        return 0;
+    return log(speed / STOP_SPEED) / (damping * g_tuning.time_scale);
+}
+
+// move the ball by any interval in one step, as long as nothing is hit on the way.
+// with damping k the motion has a closed form (s = time_scale * timeDiff):
+//   v(s) = v0 * exp(-k s)
+//   x(s) = x0 + v0 * (1 - exp(-k s)) / k      (x0 + v0 s when k == 0)
+void advanceBall(BallState& ball, float timeDiff, double damping)
+{
+    if (fabs(ball.vx) <= STOP_SPEED && fabs(ball.vz) <= STOP_SPEED)
+    {
+        ball.vx = 0;
+        ball.vz = 0;
+        return;
+    }
+
+    double stopTime = timeToStop(ball, damping);
+    bool stops = timeDiff >= stopTime;
+    double s = g_tuning.time_scale * (stops ? stopTime : timeDiff);
+
+    double decay = 1.0;
+    double travel = s;
+    if (damping > 0)
+    {
+        decay = exp(-damping * s);
+        travel = (1.0 - decay) / damping;
+    }
+
+    ball.x = (float)(ball.x + ball.vx * travel);
+    ball.z = (float)(ball.z + ball.vz * travel);
+    if (stops) {
+        ball.vx = 0;
+        ball.vz = 0;
+    }
+    else {
+        ball.vx = (float)(ball.vx * decay);
+        ball.vz = (float)(ball.vz * decay);
+    }
+}
+
+void placeBall(BallState& ball, float x, float z)
+{
+    ball.x = ball.pre_x = x;
+    ball.z = ball.pre_z = z;
+    ball.vx = 0;
+    ball.vz = 0;
+}
+
+// put state at the start of a game on level
+void resetState(const Level& level, SimState& state)
+{
+    for (int w = 0; w < ALIVE_WORDS; w++) {
+        int bricks = level.count - w * 32;
+        state.alive[w] = bricks >= 32 ? 0xffffffffu : (bricks > 0 ? (1u << bricks) - 1 : 0);
+    }
+    placeBall(state.paddle, 0.0f, PADDLE_Z);
+    placeBall(state.ball, 0.0f, PADDLE_Z + g_tuning.radius * 2);   // red ball on top of it
+    placeBall(state.rival, 0.0f, PADDLE_Z);
+    state.started = false;
+    state.versus = false;
+    state.server = 0;
+    state.hitter = 0;
+    state.score[0] = 0;
+    state.score[1] = 0;
+    state.tick = 0;
+}
+
+BallState& serverPaddle(SimState& state)
+{
+    return state.server == 0 ? state.paddle : state.rival;
+}
+
+void launch(SimState& state)
+{
+    state.ball.vx = 0;
+    state.ball.vz = g_tuning.launch_speed;
+    state.started = true;
+    state.hitter = state.server;
+    recordEvent(state, EVENT_LAUNCH, 0);
+}
+
+// apply the input of one frame to the simulation
+void applyInput(SimState& state, const FrameInput& input)
+{
+    state.paddle.x = input.paddle_x;
+
+    if (input.launch && !state.started)
+        launch(state);
+}
+
+// only the player who serves can launch
+void applyInputs(SimState& state, const FrameInput inputs[2])
+{
+    state.paddle.x = inputs[0].paddle_x;
+    state.rival.x = inputs[1].paddle_x;
+
+    if (inputs[state.server].launch && !state.started)
+        launch(state);
+}
+
+// the session differs between peers and is left out
+unsigned int hashState(const SimState& state)
+{
+    unsigned int hash = 2166136261u;
+    float values[12] = {
+        state.paddle.x, state.paddle.z, state.paddle.vx, state.paddle.vz,
+        state.ball.x, state.ball.z, state.ball.vx, state.ball.vz,
+        state.rival.x, state.rival.z, state.rival.vx, state.rival.vz,
+    };
+    unsigned int flags[5] = {
+        state.started ? 1u : 0u, state.versus ? 1u : 0u,
+        (unsigned int)state.server | ((unsigned int)state.hitter << 8),
+        (unsigned int)state.score[0] | ((unsigned int)state.score[1] << 16),
+        state.tick,
+    };
+
+    const unsigned char* bytes = (const unsigned char*)values;
+    for (size_t k = 0; k < sizeof(values); k++) {
+        hash ^= bytes[k];
+        hash *= 16777619u;
+    }
+    bytes = (const unsigned char*)flags;
+    for (size_t k = 0; k < sizeof(flags); k++) {
+        hash ^= bytes[k];
+        hash *= 16777619u;
+    }
+    bytes = (const unsigned char*)state.alive;
+    for (size_t k = 0; k < sizeof(state.alive); k++) {
+        hash ^= bytes[k];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// damping constant for advanceBall() that keeps DECREASE_RATE of the speed per 60 fps frame
+double frictionDamping(void)
+{
+    return -log(DECREASE_RATE) / (g_tuning.time_scale * SIM_STEP);
+}
+
+// damping the balls move with under the current tuning
+double ballDamping(void)
+{
+    return g_tuning.friction != 0 ? frictionDamping() : 0.0;
+}
+
+// move every ball by timeDelta in one step without looking for collisions.
+// a caller fast-forwarding the game advances up to the next contact, resolves it and repeats.
+void advanceWorld(SimState& state, float timeDelta)
+{
+    double damping = ballDamping();
+    advanceBall(state.paddle, timeDelta, damping);
+    advanceBall(state.ball, timeDelta, damping);
+}
+
+double timeToRest(const SimState& state)
+{
+    double damping = ballDamping();
+    double paddle = timeToStop(state.paddle, damping);
+    double ball = timeToStop(state.ball, damping);
+    return paddle > ball ? paddle : ball;
+}
+
+// -----------------------------------------------------------------------------
+// Contacts
+// a step first collects everything the ball touches and then resolves it in a
+// fixed order (bricks by index, walls, paddles), so the outcome never depends on
+// the order the strips were searched in. every contact involves the one moving
+// ball, so no two contacts are independent: a graph coloring would give each
+// its own color, and the solve stays sequential. resolving a contact can push
+// the ball into a new one, so collection repeats until nothing new shows up.
+// -----------------------------------------------------------------------------
+enum { CONTACT_BRICK, CONTACT_WALL, CONTACT_PADDLE };
+
+struct Contact {
+    int kind;
+    int index;
+};
+
+const int MAX_CONTACTS = MAX_BRICKS + WALL_COUNT + 2;
+
+// one slot per object for the resolved[] flags
+int contactId(const Contact& contact)
+{
+    if (contact.kind == CONTACT_BRICK)
+        return contact.index;
+    if (contact.kind == CONTACT_WALL)
+        return MAX_BRICKS + contact.index;
+    return MAX_BRICKS + WALL_COUNT + contact.index;
+}
+
+// collects the contacts of the ball that are not resolved yet, sorted into resolve order
+int findContacts(const Level& level, SimState& state, const bool* resolved, Contact* contacts)
+{
+    Contact contact;
+    int count = 0;
+    int i;
+
+    // only the strips the ball overlaps can hold a brick it touches
+    float reach = g_tuning.radius * 2;
+    int first = chunkOf(state.ball.z - reach);
+    int last = chunkOf(state.ball.z + reach);
+    for (int c = first; c <= last; c++) {
+        for (int k = level.chunkStart[c]; k < level.chunkStart[c + 1]; k++) {
+            contact.kind = CONTACT_BRICK;
+            contact.index = level.chunkBricks[k];
+            if (!resolved[contactId(contact)] && brickAlive(state, contact.index) &&
+                ballsTouch(level.pos[contact.index][0], level.pos[contact.index][1], state.ball))
+                contacts[count++] = contact;
+        }
+    }
+    for (i = 0; i < WALL_COUNT; i++) {
+        contact.kind = CONTACT_WALL;
+        contact.index = i;
+        if (!resolved[contactId(contact)] && wallTouches(WALL_LAYOUT[i], state.ball))
+            contacts[count++] = contact;
+    }
+    contact.kind = CONTACT_PADDLE;
+    contact.index = 0;
+    if (!resolved[contactId(contact)] && ballsTouch(state.paddle.x, state.paddle.z, state.ball))
+        contacts[count++] = contact;
+    contact.index = 1;
+    if (state.versus && !resolved[contactId(contact)] && ballsTouch(state.rival.x, state.rival.z, state.ball))
+        contacts[count++] = contact;
+
+    // insertion sort by slot; there are only a few
+    for (i = 1; i < count; i++) {
+        Contact key = contacts[i];
+        int j = i - 1;
+        while (j >= 0 && contactId(contacts[j]) > contactId(key)) {
+            contacts[j + 1] = contacts[j];
+            j--;
+        }
+        contacts[j + 1] = key;
+    }
+    return count;
+}
+
+int simulate(const Level& level, SimState& state, float timeDelta)
+{
+    int collisions = 0;
+
+    state.tick++;
+    if (state.started)
+    {
+        bool resolved[MAX_CONTACTS] = { false };
+        Contact contacts[MAX_CONTACTS];
+        int count;
+        while ((count = findContacts(level, state, resolved, contacts)) > 0) {
+            for (int k = 0; k < count; k++) {
+                bool hit = false;
+                int index = contacts[k].index;
+                if (contacts[k].kind == CONTACT_BRICK) {
+                    // a brick breaks at the first hit
+                    hit = bounceOffBall(level.pos[index][0], level.pos[index][1], state.ball);
+                    if (hit) {
+                        setBrickAlive(state, index, false);
+                        state.score[state.hitter]++;
+                        recordEvent(state, EVENT_HIT, index);
+                        recordEvent(state, EVENT_BRICK, index);
+                    }
+                }
+                else if (contacts[k].kind == CONTACT_WALL) {
+                    hit = bounceOffWall(WALL_LAYOUT[index], state.ball);
+                    if (hit)
+                        recordEvent(state, EVENT_BOUNCE, index);
+                }
+                else {
+                    const BallState& paddle = index == 0 ? state.paddle : state.rival;
+                    hit = bounceOffBall(paddle.x, paddle.z, state.ball);
+                    if (hit) {
+                        state.hitter = (unsigned char)index;
+                        recordEvent(state, EVENT_BOUNCE, WALL_COUNT + index);
+                    }
+                }
+                if (hit)
+                    collisions++;
+                resolved[contactId(contacts[k])] = true;
+            }
+        }
+
+        if (state.ball.z < -5.0f)
+        {
+            // ball lost: put the same ball back on the paddle instead of building a new mesh.
+            // in a versus game the serve goes to the other player.
+            recordEvent(state, EVENT_LOST, 0);
+            if (state.versus)
+                state.server = (unsigned char)(1 - state.server);
+            BallState& paddle = serverPaddle(state);
+            placeBall(state.ball, paddle.x, paddle.z + g_tuning.radius * 2);
+            state.started = false;
+        }
+
+        // remember where the ball is, then move it
+        state.ball.pre_x = state.ball.x;
+        state.ball.pre_z = state.ball.z;
+        advanceWorld(state, timeDelta);
+    }
+    else //  ų space  ȴ 
+    {
+        BallState& paddle = serverPaddle(state);
+        placeBall(state.ball, paddle.x, paddle.z + g_tuning.radius * 2);
+    }
+    return collisions;
+}
+
+// -----------------------------------------------------------------------------
+// Residency
+// -----------------------------------------------------------------------------
+void clearResidency(Residency& residency)
+{
+    memset(residency.resident, 0, sizeof(residency.resident));
+    residency.count = 0;
+    residency.loaded = 0;
+    residency.evicted = 0;
+}
+
+void updateResidency(const Level& level, const SimState& state, const bool seen[CHUNK_COUNT], Residency& residency)
+{
+    int ball = chunkOf(state.ball.z);
+    residency.count = 0;
+    residency.loaded = 0;
+    residency.evicted = 0;
+    for (int c = 0; c < CHUNK_COUNT; c++) {
+        bool resident = seen[c] || (c >= ball - RESIDENT_REACH && c <= ball + RESIDENT_REACH);
+        if (resident != residency.resident[c]) {
+            residency.resident[c] = resident;
+            if (resident)
+                residency.loaded++;
+            else
+                residency.evicted++;
+        }
+        if (!resident)
+            continue;
+        for (int k = level.chunkStart[c]; k < level.chunkStart[c + 1]; k++)
+            residency.bricks[residency.count++] = level.chunkBricks[k];
+    }
+}
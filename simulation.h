@@ -0,0 +1,156 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simulation.h
+//
+// Desc: The game itself: the level, the ball physics and one step of play. Nothing in
+//       here touches Windows or Direct3D, so the same code runs the game in the window,
+//       the shot solver and the headless training environments (legoEnv.h).
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simulationH__
+#define __simulationH__
+
+#define M_RADIUS 0.21   // default ball radius
+#define DECREASE_RATE 0.9982    // speed kept per frame at 60 fps when friction is on
+#define STOP_SPEED 0.01         // a ball slower than this on both axes stops
+#define MAX_BRICKS 320          // balls of M_RADIUS side by side fill the table with 15 x 21
+#define ALIVE_WORDS ((MAX_BRICKS + 31) / 32)
+#define WALL_COUNT 3
+
+#define PADDLE_Z -4.5f          // the paddle only moves along x
+#define PADDLE_MIN_X -3.0f      // paddle range between the side walls
+#define PADDLE_MAX_X 3.0f
+
+#define CHUNK_DEPTH 1.0f
+#define CHUNK_COUNT 9           // covers the 9 deep table
+#define TABLE_NEAR_Z -4.5f
+
+#define SIM_STEP (0.7f / 60.0f)     // timeDelta of one simulate() tick, a 60 fps frame
+
+// -----------------------------------------------------------------------------
+// Tuning values, can be reloaded from the -tuning file while the game runs
+// -----------------------------------------------------------------------------
+struct Tuning {
+    float radius;           // ball radius
+    float time_scale;       // ball velocity units per unit of timeDelta
+    float launch_speed;     // speed of the ball when space is pressed
+    float friction;         // 1: the balls lose speed by DECREASE_RATE, 0: they keep it
+};
+extern Tuning g_tuning;
+
+// -----------------------------------------------------------------------------
+// Level
+// where the bricks stand. the table is cut into strips along z; the ball only
+// tests the bricks of the strips it overlaps, not every brick on the board.
+// bricks are stored by strip (chunkBricks[chunkStart[c] .. chunkStart[c + 1]]),
+// so the memory used does not depend on how the bricks are spread over the
+// table. buildChunks() must run after pos or count changed.
+// -----------------------------------------------------------------------------
+struct Level {
+    float pos[MAX_BRICKS][2];   // (x, z) of each brick
+    int count;
+    int chunkStart[CHUNK_COUNT + 1];
+    int chunkBricks[MAX_BRICKS];
+};
+
+void defaultLevel(Level& level);
+// returns the number of bricks read, at most MAX_BRICKS, or -1 if the file can't be
+// opened. listed gets the number of bricks in the file, more if some were cut off.
+int readLevel(const char* fileName, float pos[MAX_BRICKS][2], int* listed);
+void buildChunks(Level& level);
+// FNV-1a hash of the brick count and positions, to tell levels apart
+unsigned int hashLevel(const Level& level);
+
+struct WallLayout {
+    float width, height, depth;
+    float x, y, z;
+    int side;           // wall_position: 0 far, 2 right, 3 left
+};
+extern const WallLayout WALL_LAYOUT[WALL_COUNT];
+
+// -----------------------------------------------------------------------------
+// Simulation state
+// everything that changes during play, as plain numbers: where the paddle and
+// the ball are and how fast they move, and which bricks are still standing
+// (always where the Level put them). a copy is a whole game, which the shot
+// solver plays shots out on without touching the one in the window.
+// in a versus game (netplay.h) a second player moves the rival paddle next to
+// the first one. the ball waits on the paddle of the player who serves, and a
+// brick scores for the player whose paddle touched the ball last.
+// -----------------------------------------------------------------------------
+struct BallState {
+    float x, z;                 // center on the table
+    float vx, vz;               // velocity
+    float pre_x, pre_z;         // center before the last move, collisions fall back to it
+};
+
+struct SimState {
+    BallState paddle;           // white ball the player moves
+    BallState ball;             // red ball in play
+    BallState rival;            // paddle of the second player, versus only
+    unsigned int alive[ALIVE_WORDS];    // bit i % 32 of word i / 32: brick i is still standing
+    bool started;               // the ball was launched
+    bool versus;                // two players, the rival paddle takes part
+    unsigned char server;       // player whose paddle the ball waits on
+    unsigned char hitter;       // player whose paddle touched the ball last
+    unsigned short score[2];    // bricks destroyed per player
+    unsigned int session;       // game id in the event file
+    unsigned int tick;          // simulate() steps since the game started
+};
+
+// what the player asked for in one frame
+struct FrameInput {
+    float paddle_x;     // x position of the paddle
+    bool launch;        // space was pressed
+};
+
+bool brickAlive(const SimState& state, int brick);
+void setBrickAlive(SimState& state, int brick, bool alive);
+int countBricks(const SimState& state);
+
+void placeBall(BallState& ball, float x, float z);
+void resetState(const Level& level, SimState& state);
+void applyInput(SimState& state, const FrameInput& input);
+void applyInputs(SimState& state, const FrameInput inputs[2]);    // versus: player 0, player 1
+
+// FNV-1a hash of everything the players share; peers compare it to detect a desync
+unsigned int hashState(const SimState& state);
+
+double frictionDamping(void);
+double ballDamping(void);
+void advanceWorld(SimState& state, float timeDelta);
+
+// time (in timeDelta units) until the ball slows down below STOP_SPEED and stops,
+// FLT_MAX if it never does. advanceWorld() is exact across the stop, so the motion
+// needs no smaller steps there; only contacts limit how far a caller may advance.
+double timeToStop(const BallState& ball, double damping);
+// time until the paddle and the ball both rest under the current tuning. a caller
+// with no contact ahead can advance this far in one advanceWorld() and is done.
+double timeToRest(const SimState& state);
+
+// move the balls of state by one frame and resolve their collisions. returns the number of hits.
+int simulate(const Level& level, SimState& state, float timeDelta);
+
+// -----------------------------------------------------------------------------
+// Residency
+// the strips a frame works on: the ones within RESIDENT_REACH strips of the
+// ball and the ones the camera sees. simulate() only ever looks at the strips
+// the ball overlaps, which are always resident, and the game draws the bricks
+// of the resident strips only. an update walks the resident strips, so a frame
+// costs what is around the ball and in view, not the whole level.
+// -----------------------------------------------------------------------------
+#define RESIDENT_REACH 1        // strips on either side of the ball's
+
+struct Residency {
+    bool resident[CHUNK_COUNT];
+    int bricks[MAX_BRICKS];     // bricks of the resident strips, strip by strip
+    int count;
+    int loaded, evicted;        // strips that came in and went out at the last update
+};
+
+void clearResidency(Residency& residency);
+// seen[c] is true where the camera sees strip c
+void updateResidency(const Level& level, const SimState& state, const bool seen[CHUNK_COUNT], Residency& residency);
+
+#endif // __simulationH__
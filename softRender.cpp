@@ -0,0 +1,740 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: softRender.cpp
+//
+// Desc: CPU renderer for headless frames, see softRender.h.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "softRender.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+
+#define SOFT_PI 3.14159265f
+
+// -----------------------------------------------------------------------------
+// Vectors and matrices
+// row-major 4x4 matrices applied to row vectors, as D3DX builds them
+// -----------------------------------------------------------------------------
+void multiply(const float* a, const float* b, float* out)
+{
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            out[r * 4 + c] = a[r * 4 + 0] * b[0 * 4 + c] + a[r * 4 + 1] * b[1 * 4 + c] +
+                a[r * 4 + 2] * b[2 * 4 + c] + a[r * 4 + 3] * b[3 * 4 + c];
+        }
+    }
+}
+
+void transformPoint(const float* m, float x, float y, float z, float* out)
+{
+    for (int c = 0; c < 4; c++)
+        out[c] = x * m[c] + y * m[4 + c] + z * m[8 + c] + m[12 + c];
+}
+
+void normalize(float* v)
+{
+    float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+void cross(const float* a, const float* b, float* out)
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+float dot(const float* a, const float* b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+void translation(float x, float y, float z, float* m)
+{
+    memset(m, 0, sizeof(float) * 16);
+    m[0] = m[5] = m[10] = m[15] = 1.0f;
+    m[12] = x;
+    m[13] = y;
+    m[14] = z;
+}
+
+// -----------------------------------------------------------------------------
+// Meshes
+// -----------------------------------------------------------------------------
+
+// turns every triangle so its corners go counterclockwise seen from outside,
+// i.e. the cross product of its edges points along the vertex normals
+void orientOutward(SoftMesh& mesh)
+{
+    const float* p = &mesh.positions[0];
+    const float* n = &mesh.normals[0];
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+        int a = mesh.indices[t], b = mesh.indices[t + 1], c = mesh.indices[t + 2];
+        float ab[3] = { p[b * 3] - p[a * 3], p[b * 3 + 1] - p[a * 3 + 1], p[b * 3 + 2] - p[a * 3 + 2] };
+        float ac[3] = { p[c * 3] - p[a * 3], p[c * 3 + 1] - p[a * 3 + 1], p[c * 3 + 2] - p[a * 3 + 2] };
+        float face[3];
+        float normal[3] = {
+            n[a * 3] + n[b * 3] + n[c * 3],
+            n[a * 3 + 1] + n[b * 3 + 1] + n[c * 3 + 1],
+            n[a * 3 + 2] + n[b * 3 + 2] + n[c * 3 + 2],
+        };
+        cross(ab, ac, face);
+        if (dot(face, normal) < 0)
+            std::swap(mesh.indices[t + 1], mesh.indices[t + 2]);
+    }
+}
+
+void addVertex(SoftMesh& mesh, float x, float y, float z, float nx, float ny, float nz)
+{
+    mesh.positions.push_back(x);
+    mesh.positions.push_back(y);
+    mesh.positions.push_back(z);
+    mesh.normals.push_back(nx);
+    mesh.normals.push_back(ny);
+    mesh.normals.push_back(nz);
+}
+
+void addTriangle(SoftMesh& mesh, int a, int b, int c)
+{
+    mesh.indices.push_back(a);
+    mesh.indices.push_back(b);
+    mesh.indices.push_back(c);
+}
+
+// poles on the z axis, slices around it and stacks from pole to pole
+void softSphere(SoftMesh& mesh, float radius, int slices, int stacks)
+{
+    mesh = SoftMesh();
+    slices = slices < 3 ? 3 : slices;
+    stacks = stacks < 2 ? 2 : stacks;
+
+    addVertex(mesh, 0, 0, radius, 0, 0, 1);
+    for (int i = 1; i < stacks; i++) {
+        float theta = SOFT_PI * i / stacks;
+        for (int j = 0; j < slices; j++) {
+            float phi = 2.0f * SOFT_PI * j / slices;
+            float nx = sinf(theta) * cosf(phi), ny = sinf(theta) * sinf(phi), nz = cosf(theta);
+            addVertex(mesh, radius * nx, radius * ny, radius * nz, nx, ny, nz);
+        }
+    }
+    addVertex(mesh, 0, 0, -radius, 0, 0, -1);
+
+    int bottom = 1 + (stacks - 1) * slices;
+    for (int j = 0; j < slices; j++) {
+        int next = (j + 1) % slices;
+        addTriangle(mesh, 0, 1 + j, 1 + next);
+        for (int i = 0; i + 1 < stacks - 1; i++) {
+            int upper = 1 + i * slices, lower = upper + slices;
+            addTriangle(mesh, upper + j, lower + j, lower + next);
+            addTriangle(mesh, upper + j, lower + next, upper + next);
+        }
+        int last = 1 + (stacks - 2) * slices;
+        addTriangle(mesh, bottom, last + next, last + j);
+    }
+    orientOutward(mesh);
+}
+
+// centered on the origin, four vertices per side so every side has its own normal
+void softBox(SoftMesh& mesh, float width, float height, float depth)
+{
+    static const float SIDES[6][3] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+    };
+    float half[3] = { width / 2, height / 2, depth / 2 };
+
+    mesh = SoftMesh();
+    for (int s = 0; s < 6; s++) {
+        const float* n = SIDES[s];
+        int axis = n[0] != 0 ? 0 : (n[1] != 0 ? 1 : 2);
+        int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        int first = (int)mesh.positions.size() / 3;
+        for (int k = 0; k < 4; k++) {
+            float p[3];
+            p[axis] = n[axis] * half[axis];
+            p[u] = (k == 0 || k == 3) ? -half[u] : half[u];
+            p[v] = (k < 2) ? -half[v] : half[v];
+            addVertex(mesh, p[0], p[1], p[2], n[0], n[1], n[2]);
+        }
+        addTriangle(mesh, first, first + 1, first + 2);
+        addTriangle(mesh, first, first + 2, first + 3);
+    }
+    orientOutward(mesh);
+}
+
+// -----------------------------------------------------------------------------
+// Renderer
+// -----------------------------------------------------------------------------
+SoftRenderer::SoftRenderer(int width, int height, int threads)
+{
+    m_width = width;
+    m_height = height;
+    m_threads = threads < 1 ? 1 : threads;
+    m_tilesX = (width + TILE - 1) / TILE;
+    m_tilesY = (height + TILE - 1) / TILE;
+    m_wire = false;
+    m_clearColor = CLEAR_COLOR;
+    memset(m_eye, 0, sizeof(m_eye));
+    memset(m_viewProj, 0, sizeof(m_viewProj));
+    m_zNear = 1.0f;
+    memset(&m_light, 0, sizeof(m_light));
+    m_bins.resize(m_threads * m_tilesX * m_tilesY);
+    m_color.resize(width * height);
+    m_depth.resize(width * height);
+    m_nextDraw = 0;
+    m_nextTile = 0;
+    m_arrived = 0;
+}
+
+// the view and projection D3DXMatrixLookAtLH() and D3DXMatrixPerspectiveFovLH() build
+void SoftRenderer::setCamera(const float eye[3], const float at[3], const float up[3], float fovY, float zNear, float zFar)
+{
+    float zAxis[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+    float xAxis[3], yAxis[3];
+    normalize(zAxis);
+    cross(up, zAxis, xAxis);
+    normalize(xAxis);
+    cross(zAxis, xAxis, yAxis);
+
+    float view[16] = {
+        xAxis[0], yAxis[0], zAxis[0], 0,
+        xAxis[1], yAxis[1], zAxis[1], 0,
+        xAxis[2], yAxis[2], zAxis[2], 0,
+        -dot(xAxis, eye), -dot(yAxis, eye), -dot(zAxis, eye), 1,
+    };
+    float yScale = 1.0f / tanf(fovY / 2);
+    float xScale = yScale * m_height / m_width;
+    float proj[16] = {
+        xScale, 0, 0, 0,
+        0, yScale, 0, 0,
+        0, 0, zFar / (zFar - zNear), 1,
+        0, 0, -zNear * zFar / (zFar - zNear), 0,
+    };
+    multiply(view, proj, m_viewProj);
+    memcpy(m_eye, eye, sizeof(m_eye));
+    m_zNear = zNear;
+}
+
+void SoftRenderer::setLight(const SoftLight& light)
+{
+    m_light = light;
+}
+
+void SoftRenderer::draw(const SoftMesh& mesh, const float world[16], const SoftMaterial& material)
+{
+    Draw queued;
+    queued.mesh = &mesh;
+    memcpy(queued.world, world, sizeof(queued.world));
+    queued.material = material;
+    queued.firstVertex = m_draws.empty() ? 0 : m_draws.back().firstVertex + (int)m_draws.back().mesh->positions.size() / 3;
+    queued.firstTriangle = (int)m_indices.size() / 3;
+    m_draws.push_back(queued);
+    for (size_t k = 0; k < mesh.indices.size(); k++)
+        m_indices.push_back(queued.firstVertex + mesh.indices[k]);
+}
+
+bool SoftRenderer::project(const float point[3], float* x, float* y) const
+{
+    float clip[4];
+    transformPoint(m_viewProj, point[0], point[1], point[2], clip);
+    if (clip[3] < m_zNear)
+        return false;
+    *x = (clip[0] / clip[3] + 1.0f) * 0.5f * m_width;
+    *y = (1.0f - clip[1] / clip[3]) * 0.5f * m_height;
+    return true;
+}
+
+void SoftRenderer::render(void)
+{
+    int vertices = m_draws.empty() ? 0 : m_draws.back().firstVertex + (int)m_draws.back().mesh->positions.size() / 3;
+    m_vertices.resize(vertices);
+    m_triangles.resize(m_indices.size() / 3);
+    for (size_t b = 0; b < m_bins.size(); b++)
+        m_bins[b].clear();
+    m_nextDraw = 0;
+    m_nextTile = 0;
+    m_arrived = 0;
+
+    // the calling thread is worker 0
+    std::vector<std::thread> threads;
+    for (int t = 1; t < m_threads; t++)
+        threads.push_back(std::thread(&SoftRenderer::worker, this, t));
+    worker(0);
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    m_draws.clear();
+    m_indices.clear();
+}
+
+void SoftRenderer::worker(int thread)
+{
+    for (;;) {
+        int d = m_nextDraw++;
+        if (d >= (int)m_draws.size())
+            break;
+        shadeVertices(m_draws[d]);
+    }
+    arrive(1);
+
+    int count = (int)m_triangles.size();
+    int first = (int)((long long)count * thread / m_threads);
+    int last = (int)((long long)count * (thread + 1) / m_threads);
+    for (int t = first; t < last; t++)
+        setupTriangle(thread, t);
+    arrive(2);
+
+    for (;;) {
+        int tile = m_nextTile++;
+        if (tile >= m_tilesX * m_tilesY)
+            break;
+        renderTile(tile);
+    }
+}
+
+// waits until every thread finished the phase
+void SoftRenderer::arrive(int phase)
+{
+    m_arrived++;
+    while (m_arrived < phase * m_threads)
+        std::this_thread::yield();
+}
+
+// transform and light in world space, the way the fixed-function pipeline does
+// it with D3DRS_SPECULARENABLE and a local viewer
+void SoftRenderer::shadeVertices(const Draw& draw)
+{
+    const SoftMesh& mesh = *draw.mesh;
+    const float* w = draw.world;
+    const SoftColor& m = draw.material.color;
+    const SoftLight& light = m_light;
+    int count = (int)mesh.positions.size() / 3;
+
+    for (int i = 0; i < count; i++) {
+        const float* p = &mesh.positions[i * 3];
+        const float* n = &mesh.normals[i * 3];
+        Vertex& out = m_vertices[draw.firstVertex + i];
+
+        float world[4];
+        transformPoint(w, p[0], p[1], p[2], world);
+        float normal[3] = {
+            n[0] * w[0] + n[1] * w[4] + n[2] * w[8],
+            n[0] * w[1] + n[1] * w[5] + n[2] * w[9],
+            n[0] * w[2] + n[1] * w[6] + n[2] * w[10],
+        };
+        normalize(normal);
+
+        float lit[3] = { 0, 0, 0 };
+        float shine[3] = { 0, 0, 0 };
+        float toLight[3] = { light.position[0] - world[0], light.position[1] - world[1], light.position[2] - world[2] };
+        float distance = sqrtf(dot(toLight, toLight));
+        if (distance <= light.range) {
+            float falloff = light.attenuation0 + light.attenuation1 * distance + light.attenuation2 * distance * distance;
+            float attenuation = falloff > 0 ? 1.0f / falloff : 1.0f;
+            normalize(toLight);
+            float diffuse = std::max(dot(normal, toLight), 0.0f);
+            float specular = 0;
+            if (diffuse > 0) {
+                float toEye[3] = { m_eye[0] - world[0], m_eye[1] - world[1], m_eye[2] - world[2] };
+                normalize(toEye);
+                float half[3] = { toLight[0] + toEye[0], toLight[1] + toEye[1], toLight[2] + toEye[2] };
+                normalize(half);
+                float facing = dot(normal, half);
+                specular = facing > 0 ? powf(facing, draw.material.power) : 0;
+            }
+            lit[0] = m.r * (light.ambient.r + light.diffuse.r * diffuse) * attenuation;
+            lit[1] = m.g * (light.ambient.g + light.diffuse.g * diffuse) * attenuation;
+            lit[2] = m.b * (light.ambient.b + light.diffuse.b * diffuse) * attenuation;
+            shine[0] = m.r * light.specular.r * specular * attenuation;
+            shine[1] = m.g * light.specular.g * specular * attenuation;
+            shine[2] = m.b * light.specular.b * specular * attenuation;
+        }
+        out.r = std::min(std::min(lit[0], 1.0f) + shine[0], 1.0f);
+        out.g = std::min(std::min(lit[1], 1.0f) + shine[1], 1.0f);
+        out.b = std::min(std::min(lit[2], 1.0f) + shine[2], 1.0f);
+
+        float clip[4];
+        transformPoint(m_viewProj, world[0], world[1], world[2], clip);
+        out.wx = world[0];
+        out.wy = world[1];
+        out.wz = world[2];
+        out.visible = clip[3] >= m_zNear;
+        if (out.visible) {
+            out.sx = (clip[0] / clip[3] + 1.0f) * 0.5f * m_width;
+            out.sy = (1.0f - clip[1] / clip[3]) * 0.5f * m_height;
+            out.z = clip[2] / clip[3];
+        }
+    }
+}
+
+void SoftRenderer::setupTriangle(int thread, int t)
+{
+    Triangle& tri = m_triangles[t];
+    const Vertex* v[3] = {
+        &m_vertices[m_indices[t * 3]], &m_vertices[m_indices[t * 3 + 1]], &m_vertices[m_indices[t * 3 + 2]],
+    };
+    tri.minX = 1;
+    tri.maxX = 0;
+    if (!v[0]->visible || !v[1]->visible || !v[2]->visible)
+        return;
+
+    // the meshes turn counterclockwise seen from outside (orientOutward())
+    float ab[3] = { v[1]->wx - v[0]->wx, v[1]->wy - v[0]->wy, v[1]->wz - v[0]->wz };
+    float ac[3] = { v[2]->wx - v[0]->wx, v[2]->wy - v[0]->wy, v[2]->wz - v[0]->wz };
+    float toEye[3] = { m_eye[0] - v[0]->wx, m_eye[1] - v[0]->wy, m_eye[2] - v[0]->wz };
+    float face[3];
+    cross(ab, ac, face);
+    if (dot(face, toEye) <= 0)
+        return;
+
+    // corners in the order that makes the screen area positive
+    float area = (v[1]->sx - v[0]->sx) * (v[2]->sy - v[0]->sy) - (v[2]->sx - v[0]->sx) * (v[1]->sy - v[0]->sy);
+    // slivers thinner than this cover no pixel center worth drawing, and would
+    // make the color planes in fillTriangle() too steep
+    if (fabsf(area) < 1e-3f)
+        return;
+    if (area < 0)
+        std::swap(v[1], v[2]);
+    for (int k = 0; k < 3; k++) {
+        tri.x[k] = v[k]->sx;
+        tri.y[k] = v[k]->sy;
+        tri.z[k] = v[k]->z;
+        tri.c[k][0] = v[k]->r;
+        tri.c[k][1] = v[k]->g;
+        tri.c[k][2] = v[k]->b;
+    }
+
+    // pixel centers sit on whole coordinates, as in Direct3D 9
+    tri.minX = std::max((int)ceilf(std::min(std::min(tri.x[0], tri.x[1]), tri.x[2])), 0);
+    tri.minY = std::max((int)ceilf(std::min(std::min(tri.y[0], tri.y[1]), tri.y[2])), 0);
+    tri.maxX = std::min((int)floorf(std::max(std::max(tri.x[0], tri.x[1]), tri.x[2])), m_width - 1);
+    tri.maxY = std::min((int)floorf(std::max(std::max(tri.y[0], tri.y[1]), tri.y[2])), m_height - 1);
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+        return;
+
+    int tiles = m_tilesX * m_tilesY;
+    for (int ty = tri.minY / TILE; ty <= tri.maxY / TILE; ty++) {
+        for (int tx = tri.minX / TILE; tx <= tri.maxX / TILE; tx++)
+            m_bins[thread * tiles + ty * m_tilesX + tx].push_back(t);
+    }
+}
+
+void SoftRenderer::renderTile(int tile)
+{
+    int x0 = (tile % m_tilesX) * TILE, y0 = (tile / m_tilesX) * TILE;
+    int x1 = std::min(x0 + TILE, m_width), y1 = std::min(y0 + TILE, m_height);
+
+    for (int y = y0; y < y1; y++) {
+        std::fill(m_color.begin() + y * m_width + x0, m_color.begin() + y * m_width + x1, m_clearColor);
+        std::fill(m_depth.begin() + y * m_width + x0, m_depth.begin() + y * m_width + x1, 1.0f);
+    }
+
+    // bins of lower threads hold earlier triangles
+    int tiles = m_tilesX * m_tilesY;
+    for (int thread = 0; thread < m_threads; thread++) {
+        const std::vector<int>& bin = m_bins[thread * tiles + tile];
+        for (size_t k = 0; k < bin.size(); k++) {
+            const Triangle& tri = m_triangles[bin[k]];
+            if (!m_wire) {
+                fillTriangle(tri, x0, y0, x1, y1);
+                continue;
+            }
+            drawEdge(tri, 0, 1, x0, y0, x1, y1);
+            drawEdge(tri, 1, 2, x0, y0, x1, y1);
+            drawEdge(tri, 2, 0, x0, y0, x1, y1);
+        }
+    }
+}
+
+// the part of tri inside [x0, x1) x [y0, y1). every value across the triangle
+// (edge distances, depth, color) is a plane a + dx * x + dy * y.
+void SoftRenderer::fillTriangle(const Triangle& tri, int x0, int y0, int x1, int y1)
+{
+    int left = std::max(tri.minX, x0), right = std::min(tri.maxX + 1, x1);
+    int top = std::max(tri.minY, y0), bottom = std::min(tri.maxY + 1, y1);
+    if (left >= right || top >= bottom)
+        return;
+
+    const float* x = tri.x;
+    const float* y = tri.y;
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+
+    // edge k lies opposite corner k and is positive inside
+    float ex[3], ey[3], e0[3];
+    for (int k = 0; k < 3; k++) {
+        int a = (k + 1) % 3, b = (k + 2) % 3;
+        ex[k] = -(y[b] - y[a]);
+        ey[k] = x[b] - x[a];
+        e0[k] = -(ex[k] * x[a] + ey[k] * y[a]);
+    }
+
+    // the attributes weigh the corners by edge distance / area
+    float plane[4][3];      // z, r, g, b: constant, dx, dy
+    const float* values[4] = { tri.z, NULL, NULL, NULL };
+    float colors[3][3];
+    for (int ch = 0; ch < 3; ch++) {
+        for (int k = 0; k < 3; k++)
+            colors[ch][k] = tri.c[k][ch];
+        values[1 + ch] = colors[ch];
+    }
+    for (int a = 0; a < 4; a++) {
+        plane[a][0] = plane[a][1] = plane[a][2] = 0;
+        for (int k = 0; k < 3; k++) {
+            plane[a][0] += e0[k] * values[a][k] / area;
+            plane[a][1] += ex[k] * values[a][k] / area;
+            plane[a][2] += ey[k] * values[a][k] / area;
+        }
+    }
+
+    int n = right - left;
+    for (int py = top; py < bottom; py++) {
+        float fx = (float)left, fy = (float)py;
+        float w0 = e0[0] + ex[0] * fx + ey[0] * fy;
+        float w1 = e0[1] + ex[1] * fx + ey[1] * fy;
+        float w2 = e0[2] + ex[2] * fx + ey[2] * fy;
+        float zr = plane[0][0] + plane[0][1] * fx + plane[0][2] * fy;
+        float rr = plane[1][0] + plane[1][1] * fx + plane[1][2] * fy;
+        float gr = plane[2][0] + plane[2][1] * fx + plane[2][2] * fy;
+        float br = plane[3][0] + plane[3][1] * fx + plane[3][2] * fy;
+        float dw0 = ex[0], dw1 = ex[1], dw2 = ex[2];
+        float dz = plane[0][1], dr = plane[1][1], dg = plane[2][1], db = plane[3][1];
+        float* depth = &m_depth[py * m_width + left];
+        unsigned int* color = &m_color[py * m_width + left];
+
+        // no branches in this loop, one lane per pixel: the tests become bit
+        // masks and the colors are not clamped, inside the triangle they stay
+        // between the corners' colors anyway
+        for (int i = 0; i < n; i++) {
+            float fi = (float)i;
+            float z = zr + dz * fi;
+            float d = depth[i];
+            unsigned int inside =
+                (0u - (unsigned int)(w0 + dw0 * fi >= 0.0f)) & (0u - (unsigned int)(w1 + dw1 * fi >= 0.0f)) &
+                (0u - (unsigned int)(w2 + dw2 * fi >= 0.0f)) & (0u - (unsigned int)(z >= 0.0f)) &
+                (0u - (unsigned int)(z <= d));
+            unsigned int r = (unsigned int)(int)((rr + dr * fi) * 254.99f + 0.5f) & 0xff;
+            unsigned int g = (unsigned int)(int)((gr + dg * fi) * 254.99f + 0.5f) & 0xff;
+            unsigned int b = (unsigned int)(int)((br + db * fi) * 254.99f + 0.5f) & 0xff;
+            unsigned int rgb = (r << 16) | (g << 8) | b;
+            depth[i] = inside ? z : d;
+            color[i] = (rgb & inside) | (color[i] & ~inside);
+        }
+    }
+}
+
+// one edge of a wireframe triangle, clipped to the tile
+void SoftRenderer::drawEdge(const Triangle& tri, int from, int to, int x0, int y0, int x1, int y1)
+{
+    float dx = tri.x[to] - tri.x[from], dy = tri.y[to] - tri.y[from];
+    int steps = (int)ceilf(std::max(fabsf(dx), fabsf(dy)));
+    if (steps < 1)
+        steps = 1;
+    for (int s = 0; s <= steps; s++) {
+        float t = (float)s / steps;
+        int px = (int)floorf(tri.x[from] + dx * t + 0.5f);
+        int py = (int)floorf(tri.y[from] + dy * t + 0.5f);
+        if (px < x0 || px >= x1 || py < y0 || py >= y1)
+            continue;
+        float z = tri.z[from] + (tri.z[to] - tri.z[from]) * t;
+        int k = py * m_width + px;
+        if (z < 0.0f || z > m_depth[k])
+            continue;
+        float c[3];
+        for (int ch = 0; ch < 3; ch++)
+            c[ch] = tri.c[from][ch] + (tri.c[to][ch] - tri.c[from][ch]) * t;
+        m_depth[k] = z;
+        m_color[k] = ((unsigned int)(c[0] * 255.0f + 0.5f) << 16) |
+            ((unsigned int)(c[1] * 255.0f + 0.5f) << 8) | (unsigned int)(c[2] * 255.0f + 0.5f);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Image files
+// the PNG is not compressed: its zlib stream uses stored blocks, which every
+// reader accepts and which need no deflate encoder.
+// -----------------------------------------------------------------------------
+unsigned int crc32(unsigned int crc, const unsigned char* data, size_t size)
+{
+    static unsigned int table[256];
+    static bool ready = false;
+    if (!ready) {
+        for (unsigned int n = 0; n < 256; n++) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        ready = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+void putBigEndian(std::vector<unsigned char>& out, unsigned int value)
+{
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+void writeChunk(FILE* file, const char* type, const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> chunk;
+    putBigEndian(chunk, (unsigned int)data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBigEndian(chunk, crc32(0, &chunk[4], chunk.size() - 4));
+    fwrite(&chunk[0], 1, chunk.size(), file);
+}
+
+bool savePng(FILE* file, const unsigned int* pixels, int width, int height)
+{
+    static const unsigned char SIGNATURE[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    fwrite(SIGNATURE, 1, sizeof(SIGNATURE), file);
+
+    std::vector<unsigned char> header;
+    putBigEndian(header, (unsigned int)width);
+    putBigEndian(header, (unsigned int)height);
+    header.push_back(8);        // bits per channel
+    header.push_back(2);        // RGB
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    writeChunk(file, "IHDR", header);
+
+    // every row starts with filter type 0
+    std::vector<unsigned char> raw;
+    raw.reserve((size_t)(width * 3 + 1) * height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        for (int x = 0; x < width; x++) {
+            unsigned int c = pixels[y * width + x];
+            raw.push_back((unsigned char)(c >> 16));
+            raw.push_back((unsigned char)(c >> 8));
+            raw.push_back((unsigned char)c);
+        }
+    }
+
+    std::vector<unsigned char> z;
+    z.push_back(0x78);
+    z.push_back(0x01);
+    size_t done = 0;
+    do {
+        size_t size = std::min(raw.size() - done, (size_t)65535);
+        z.push_back(done + size == raw.size() ? 1 : 0);
+        z.push_back((unsigned char)size);
+        z.push_back((unsigned char)(size >> 8));
+        z.push_back((unsigned char)~size);
+        z.push_back((unsigned char)(~size >> 8));
+        z.insert(z.end(), raw.begin() + done, raw.begin() + done + size);
+        done += size;
+    } while (done < raw.size());
+    unsigned int a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBigEndian(z, (b << 16) | a);
+    writeChunk(file, "IDAT", z);
+    writeChunk(file, "IEND", std::vector<unsigned char>());
+    return true;
+}
+
+bool SoftRenderer::save(const char* fileName) const
+{
+    FILE* file = fopen(fileName, "wb");
+    if (file == NULL)
+        return false;
+
+    size_t length = strlen(fileName);
+    bool png = length >= 4 && (strcmp(fileName + length - 4, ".png") == 0 || strcmp(fileName + length - 4, ".PNG") == 0);
+    if (png)
+        savePng(file, &m_color[0], m_width, m_height);
+    else {
+        fprintf(file, "P6\n%d %d\n255\n", m_width, m_height);
+        std::vector<unsigned char> row(m_width * 3);
+        for (int y = 0; y < m_height; y++) {
+            for (int x = 0; x < m_width; x++) {
+                unsigned int c = m_color[y * m_width + x];
+                row[x * 3] = (unsigned char)(c >> 16);
+                row[x * 3 + 1] = (unsigned char)(c >> 8);
+                row[x * 3 + 2] = (unsigned char)c;
+            }
+            fwrite(&row[0], 1, row.size(), file);
+        }
+    }
+    bool ok = ferror(file) == 0;
+    return fclose(file) == 0 && ok;
+}
+
+// -----------------------------------------------------------------------------
+// Board
+// -----------------------------------------------------------------------------
+const SoftColor SOFT_WHITE = { 1.0f, 1.0f, 1.0f };
+const SoftColor SOFT_RED = { 1.0f, 0.0f, 0.0f };
+const SoftColor SOFT_GREEN = { 0.0f, 1.0f, 0.0f };
+const SoftColor SOFT_BLUE = { 0.0f, 0.0f, 1.0f };
+const SoftColor SOFT_YELLOW = { 1.0f, 1.0f, 0.0f };
+const SoftColor SOFT_DARKRED = { 215.0f / 255.0f, 0.0f, 0.0f };
+
+void buildBoard(SoftBoard& board, float radius, int slices)
+{
+    softBox(board.table, TABLE_WIDTH, TABLE_HEIGHT, TABLE_DEPTH);
+    for (int i = 0; i < WALL_COUNT; i++)
+        softBox(board.walls[i], WALL_LAYOUT[i].width, WALL_LAYOUT[i].height, WALL_LAYOUT[i].depth);
+    softSphere(board.ball, radius, slices, slices);
+    softSphere(board.light, LIGHT_RADIUS, 10, 10);
+}
+
+void drawMesh(SoftRenderer& renderer, const SoftMesh& mesh, float x, float y, float z, const SoftColor& color, float power)
+{
+    float world[16];
+    SoftMaterial material = { color, power };
+    translation(x, y, z, world);
+    renderer.draw(mesh, world, material);
+}
+
+// in the order drawWorld() draws them
+void drawBoard(SoftRenderer& renderer, const SoftBoard& board, const Level& level, const SimState& state)
+{
+    const float eye[3] = { 0.0f, CAMERA_Y, CAMERA_Z };
+    const float at[3] = { 0.0f, 0.0f, 0.0f };
+    const float up[3] = { 0.0f, 2.0f, 0.0f };
+    renderer.setCamera(eye, at, up, SOFT_PI / 4, 1.0f, 100.0f);
+
+    SoftLight light;
+    light.position[0] = 0.0f;
+    light.position[1] = LIGHT_Y;
+    light.position[2] = 0.0f;
+    light.diffuse = SOFT_WHITE;
+    light.specular.r = light.specular.g = light.specular.b = 0.9f;
+    light.ambient.r = light.ambient.g = light.ambient.b = 0.9f;
+    light.range = 100.0f;
+    light.attenuation0 = 0.0f;
+    light.attenuation1 = 0.9f;
+    light.attenuation2 = 0.0f;
+    renderer.setLight(light);
+
+    drawMesh(renderer, board.table, 0.0f, TABLE_Y, 0.0f, SOFT_GREEN, 5.0f);
+    for (int i = 0; i < WALL_COUNT; i++)
+        drawMesh(renderer, board.walls[i], WALL_LAYOUT[i].x, WALL_LAYOUT[i].y, WALL_LAYOUT[i].z, SOFT_DARKRED, 5.0f);
+    for (int i = 0; i < level.count; i++) {
+        if (brickAlive(state, i))
+            drawMesh(renderer, board.ball, level.pos[i][0], g_tuning.radius, level.pos[i][1], SOFT_YELLOW, 5.0f);
+    }
+    drawMesh(renderer, board.ball, state.paddle.x, BALL_Y, state.paddle.z, SOFT_WHITE, 5.0f);
+    drawMesh(renderer, board.ball, state.ball.x, BALL_Y, state.ball.z, SOFT_RED, 5.0f);
+    if (state.versus)
+        drawMesh(renderer, board.ball, state.rival.x, BALL_Y, state.rival.z, SOFT_BLUE, 5.0f);
+    drawMesh(renderer, board.light, 0.0f, LIGHT_Y, 0.0f, SOFT_WHITE, 2.0f);
+}
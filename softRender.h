@@ -0,0 +1,178 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: softRender.h
+//
+// Desc: A CPU renderer for the part of the fixed-function pipeline Display() uses: lit,
+//       Gouraud-shaded triangle meshes under one point light, a depth buffer and a
+//       wireframe mode. It needs no GPU, no window and no Direct3D, so frames of the
+//       board can be rendered on servers and in tests (tests/softRenderTest.cpp).
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __softRenderH__
+#define __softRenderH__
+
+#include "simulation.h"
+#include <vector>
+#include <atomic>
+
+// -----------------------------------------------------------------------------
+// Board layout
+// where the table, the light and the camera are. Setup() in virtualLego.cpp
+// builds the Direct3D scene from the same numbers.
+// -----------------------------------------------------------------------------
+#define TABLE_WIDTH 6.6f
+#define TABLE_HEIGHT 0.03f
+#define TABLE_DEPTH 9.0f
+#define TABLE_Y (-0.0006f / 5)
+#define BALL_Y 0.12f            // height of paddle and ball above the table, for drawing
+#define LIGHT_Y 4.0f            // the point light hangs over the middle of the table
+#define LIGHT_RADIUS 0.1f       // size of the ball that shows where the light is
+#define CAMERA_Y 8.0f           // the camera looks from (0, CAMERA_Y, CAMERA_Z) at the middle
+#define CAMERA_Z -8.0f
+#define CLEAR_COLOR 0x00afafaf
+
+// -----------------------------------------------------------------------------
+// Meshes and materials
+// a mesh is a list of vertices (position and normal) and triangles. the
+// generators make the same shapes as D3DXCreateSphere() and D3DXCreateBox().
+// -----------------------------------------------------------------------------
+struct SoftColor {
+    float r, g, b;
+};
+
+struct SoftMaterial {
+    SoftColor color;        // ambient, diffuse and specular, like the game's objects
+    float power;            // specular exponent
+};
+
+struct SoftMesh {
+    std::vector<float> positions;   // x, y, z per vertex
+    std::vector<float> normals;     // x, y, z per vertex
+    std::vector<int> indices;       // three per triangle
+};
+
+void softSphere(SoftMesh& mesh, float radius, int slices, int stacks);
+void softBox(SoftMesh& mesh, float width, float height, float depth);
+
+struct SoftLight {
+    float position[3];
+    SoftColor diffuse, specular, ambient;
+    float range;
+    float attenuation0, attenuation1, attenuation2;
+};
+
+// -----------------------------------------------------------------------------
+// Renderer
+// draw() only queues a mesh; render() runs the whole frame on threads:
+//   1. vertices are transformed and lit, one draw at a time per thread
+//   2. triangles facing away are dropped, the rest are set up and sorted into
+//      TILE x TILE screen tiles, each thread a contiguous range of them
+//   3. every thread clears and fills whole tiles. the pixels of a row in a tile
+//      are one straight loop without branches, which the compiler turns into
+//      SIMD code.
+// triangles reach each tile in the order they were drawn, so the image does
+// not depend on the number of threads. colors are interpolated linearly on
+// the screen, and a triangle with a corner behind the near plane is dropped
+// (no part of the board comes that close to the camera).
+// the buffers grow on the first frame and are reused after that.
+// -----------------------------------------------------------------------------
+class SoftRenderer {
+public:
+    enum { TILE = 64 };
+
+    SoftRenderer(int width, int height, int threads);
+
+    void setCamera(const float eye[3], const float at[3], const float up[3], float fovY, float zNear, float zFar);
+    void setLight(const SoftLight& light);
+    void setWireframe(bool wire) { m_wire = wire; }
+    void setClearColor(unsigned int color) { m_clearColor = color; }
+
+    // world is a row-major matrix applied to row vectors, as in Direct3D. the
+    // mesh must stay alive until render() returns.
+    void draw(const SoftMesh& mesh, const float world[16], const SoftMaterial& material);
+    void render(void);
+
+    // where a point of the world ends up on the screen; false behind the camera
+    bool project(const float point[3], float* x, float* y) const;
+
+    int getWidth(void) const { return m_width; }
+    int getHeight(void) const { return m_height; }
+    unsigned int getPixel(int x, int y) const { return m_color[y * m_width + x]; }  // 0x00RRGGBB
+    const unsigned int* getPixels(void) const { return &m_color[0]; }
+
+    // writes the frame as a binary PPM, or as a PNG when fileName ends in .png
+    bool save(const char* fileName) const;
+
+private:
+    struct Draw {
+        const SoftMesh* mesh;
+        float world[16];
+        SoftMaterial material;
+        int firstVertex;
+        int firstTriangle;
+    };
+
+    struct Vertex {
+        float wx, wy, wz;       // world position, for culling
+        float sx, sy, z;        // screen position and depth
+        float r, g, b;          // lit color
+        bool visible;           // in front of the near plane
+    };
+
+    struct Triangle {
+        float x[3], y[3], z[3];
+        float c[3][3];
+        int minX, minY, maxX, maxY;     // pixels it may cover, empty if culled
+    };
+
+    void worker(int thread);
+    void arrive(int phase);
+    void shadeVertices(const Draw& draw);
+    void setupTriangle(int thread, int t);
+    void renderTile(int tile);
+    void fillTriangle(const Triangle& tri, int x0, int y0, int x1, int y1);
+    void drawEdge(const Triangle& tri, int from, int to, int x0, int y0, int x1, int y1);
+
+    int m_width, m_height;
+    int m_threads;
+    int m_tilesX, m_tilesY;
+    bool m_wire;
+    unsigned int m_clearColor;
+
+    float m_eye[3];
+    float m_viewProj[16];
+    float m_zNear;
+    SoftLight m_light;
+
+    std::vector<Draw> m_draws;
+    std::vector<int> m_indices;             // of every queued triangle, into m_vertices
+    std::vector<Vertex> m_vertices;
+    std::vector<Triangle> m_triangles;
+    std::vector<std::vector<int> > m_bins;  // [thread * tiles + tile]: triangles in draw order
+    std::vector<unsigned int> m_color;
+    std::vector<float> m_depth;
+
+    // render() progress, shared by the threads of one frame
+    std::atomic<int> m_nextDraw;
+    std::atomic<int> m_nextTile;
+    std::atomic<int> m_arrived;
+};
+
+// -----------------------------------------------------------------------------
+// Board
+// the scene of one game: table, walls, bricks, paddles, ball and light, as
+// drawWorld() shows it without a mouse drag.
+// -----------------------------------------------------------------------------
+struct SoftBoard {
+    SoftMesh table;
+    SoftMesh walls[WALL_COUNT];
+    SoftMesh ball;          // bricks, paddles and ball share it
+    SoftMesh light;
+};
+
+// slices as in the sphere detail of the current quality level
+void buildBoard(SoftBoard& board, float radius, int slices);
+void drawBoard(SoftRenderer& renderer, const SoftBoard& board, const Level& level, const SimState& state);
+
+#endif // __softRenderH__
@@ -0,0 +1,46 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: telemetry.h
+//
+// Desc: Layout of the shared-memory ring the game writes one sample into per frame.
+//       The game is the only writer; monitors map the segment read-only by name and
+//       tail it (see telemetryTail.cpp). The writer never waits for readers. Every
+//       game has its own segment, named after its process id, so several games can
+//       run side by side.
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __telemetryH__
+#define __telemetryH__
+
+#define TELEMETRY_NAME     "Local\\VirtualLegoTelemetry.%lu"  // sprintf() with the process id
+#define TELEMETRY_NAME_MAX 64
+#define TELEMETRY_MAGIC    0x4C454754
+#define TELEMETRY_VERSION  3
+#define TELEMETRY_CAPACITY 1024     // must be a power of two
+
+struct TelemetrySample
+{
+	unsigned int frame;
+	float        frameMs;       // time since the previous frame
+	float        simMs;         // collision and movement update
+	float        drawMs;        // Clear() to EndScene()
+	float        presentMs;     // Present()
+	unsigned int collisions;    // ball-ball and ball-wall hits in this frame
+	unsigned int liveBricks;
+	unsigned int culled;        // objects skipped by frustum culling
+	float        ballVx;        // velocity of the ball in play
+	float        ballVz;
+	float        inputMs;       // oldest input shown by this frame to end of Present(), 0 = no input
+};
+
+struct TelemetryRing
+{
+	unsigned int    magic;
+	unsigned int    version;
+	unsigned int    capacity;
+	volatile long   written;    // samples written so far. sample n is at samples[n % capacity]
+	TelemetrySample samples[TELEMETRY_CAPACITY];
+};
+
+#endif // __telemetryH__
@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: telemetryTail.cpp
+//
+// Desc: Console tool that tails the telemetry ring of a running game and prints one
+//       line per frame. The game is picked by its process id (Task Manager shows it).
+//       Not part of the game project, build it on its own:
+//
+//           cl /EHsc telemetryTail.cpp
+//           telemetryTail <pid>
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <windows.h>
+#include <cstdio>
+#include <cstdlib>
+#include "telemetry.h"
+
+int main(int argc, char* argv[])
+{
+	unsigned long pid = argc == 2 ? strtoul(argv[1], NULL, 10) : 0;
+	if( pid == 0 )
+	{
+		printf("usage: telemetryTail <pid of the game>\n");
+		return 1;
+	}
+
+	char name[TELEMETRY_NAME_MAX];
+	sprintf(name, TELEMETRY_NAME, pid);
+	HANDLE map = ::OpenFileMapping(FILE_MAP_READ, FALSE, name);
+	if( !map )
+	{
+		printf("no running game found (%s)\n", name);
+		return 1;
+	}
+
+	const TelemetryRing* ring = (const TelemetryRing*)::MapViewOfFile(map, FILE_MAP_READ, 0, 0, sizeof(TelemetryRing));
+	if( !ring || ring->magic != TELEMETRY_MAGIC || ring->version != TELEMETRY_VERSION )
+	{
+		printf("telemetry segment has an unknown layout\n");
+		return 1;
+	}
+
+	long next = ring->written;
+	for(;;)
+	{
+		// sample written is being filled in right now, and it goes into the slot of
+		// sample written - capacity. so stay at most capacity - 1 samples behind.
+		long written = ring->written;
+		if( written - next >= (long)ring->capacity )
+		{
+			printf("-- skipped %ld samples\n", written - next - (long)ring->capacity + 1);
+			next = written - (long)ring->capacity + 1;
+		}
+
+		while( next < written )
+		{
+			TelemetrySample s = ring->samples[next & (ring->capacity - 1)];
+
+			// the writer may have lapped us while we were copying
+			if( ring->written - next >= (long)ring->capacity )
+				break;
+
+			printf("%8u %6.2fms sim %5.2f draw %5.2f present %5.2f hits %2u bricks %3u culled %2u v (%5.2f, %5.2f) input %5.2f\n",
+				s.frame, s.frameMs, s.simMs, s.drawMs, s.presentMs,
+				s.collisions, s.liveBricks, s.culled, s.ballVx, s.ballVz, s.inputMs);
+			next++;
+		}
+
+		::Sleep(15);
+	}
+}
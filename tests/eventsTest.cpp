@@ -0,0 +1,179 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: eventsTest.cpp
+//
+// Desc: Records the events of a training environment (legoEnv.h) that launches the ball
+//       straight at the only brick, reads the file back with readEventBlock() (events.h)
+//       and checks every column. Then floods the writer with blocks and checks that
+//       flushEvents() drops what does not fit instead of waiting, and counts it. Not part
+//       of the game project, build and run it on its own (any platform):
+//
+//           g++ -std=c++14 -O2 -pthread -I.. eventsTest.cpp ../legoEnv.cpp ../simulation.cpp ../events.cpp && ./a.out
+//           cl /EHsc /I.. eventsTest.cpp ..\legoEnv.cpp ..\simulation.cpp ..\events.cpp
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <vector>
+#include "legoEnv.h"
+#include "events.h"
+
+namespace
+{
+	const char* LEVEL_FILE = "eventsTest.level";
+	const char* EVENT_FILE = "eventsTest.events";
+	const int   MAX_STEPS  = 600;      // ten seconds of play
+	const int   FLOOD      = 64;       // blocks flushed at once, far more than EVENT_QUEUE
+
+	EventBuffer g_block, g_next;
+
+	int g_failures = 0;
+
+	void check(bool ok, const char* what)
+	{
+		printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+		if( !ok )
+			g_failures++;
+	}
+
+	bool writeLevel(void)
+	{
+		FILE* file = fopen(LEVEL_FILE, "w");
+		if( !file )
+			return false;
+		fprintf(file, "# one brick far up the table, straight in front of the paddle\n");
+		fprintf(file, "0 3\n");
+		fclose(file);
+		return true;
+	}
+}
+
+// launch, hit and destroy the brick, the game starts over and launches again:
+// four events, read back column by column
+void testRoundTrip(void)
+{
+	check(LegoEnvOpenEvents(EVENT_FILE) == 1, "the event file is created");
+	LegoEnvs* envs = LegoEnvCreate(1, LEVEL_FILE);
+	check(envs != NULL, "the level file is read");
+	if( !envs )
+	{
+		LegoEnvCloseEvents();
+		return;
+	}
+
+	LegoAction action = { 0.0f, 1 };
+	float observation[LEGO_ENV_OBS_SIZE];
+	float reward = 0.0f;
+	unsigned char done = 0;
+	unsigned int steps = 0;
+	LegoEnvReset(envs, observation);
+	while( !done && steps < MAX_STEPS )
+	{
+		LegoEnvStep(envs, &action, observation, &reward, &done);
+		steps++;
+	}
+	check(done && reward == 1.0f, "the brick is destroyed");
+	LegoEnvStep(envs, &action, observation, &reward, &done);     // the next game launches
+	LegoEnvDestroy(envs);
+	LegoEnvCloseEvents();
+	check(LegoEnvEventsDropped() == 0, "no event is dropped");
+
+	FILE* file = fopen(EVENT_FILE, "rb");
+	bool read = file && readEventHeader(file) && readEventBlock(file, g_block);
+	bool end = file && !readEventBlock(file, g_next);
+	if( file )
+		fclose(file);
+	remove(EVENT_FILE);
+	check(read && end, "the file holds one block");
+	if( !read || g_block.count != 4 )
+	{
+		check(false, "the block holds four events");
+		return;
+	}
+	printf("      session %u %u %u %u, tick %u %u %u %u, z %d %d %d %d\n",
+		g_block.session[0], g_block.session[1], g_block.session[2], g_block.session[3],
+		g_block.tick[0], g_block.tick[1], g_block.tick[2], g_block.tick[3],
+		g_block.z[0], g_block.z[1], g_block.z[2], g_block.z[3]);
+
+	check(g_block.kind[0] == EVENT_LAUNCH && g_block.kind[1] == EVENT_HIT &&
+		g_block.kind[2] == EVENT_BRICK && g_block.kind[3] == EVENT_LAUNCH, "kind: launch, hit, brick, launch");
+	check(g_block.object[0] == 0 && g_block.object[1] == 0 && g_block.object[2] == 0 && g_block.object[3] == 0,
+		"object: the only brick");
+	check(g_block.session[1] == g_block.session[0] && g_block.session[2] == g_block.session[0] &&
+		g_block.session[3] == g_block.session[0] + 1, "session: the next game is the next session");
+	check(g_block.tick[0] == 0 && g_block.tick[1] == steps && g_block.tick[2] == steps && g_block.tick[3] == 0,
+		"tick: the launch before the first step, the hit on the last");
+	check(g_block.x[0] == 0 && g_block.x[1] == 0 && g_block.x[2] == 0 && g_block.x[3] == 0,
+		"x: the ball flies straight up the middle");
+	check(g_block.z[3] == g_block.z[0] && g_block.z[1] == g_block.z[2] &&
+		g_block.z[1] > g_block.z[0] && g_block.z[1] < (int)(3.0f * EVENT_QUANT),
+		"z: launched from the paddle, hit just short of the brick");
+}
+
+// the writer cannot keep up with a burst of blocks: flushEvents() returns at
+// once, and every event is either in the file or counted as dropped
+void testDrop(void)
+{
+	check(openEvents(EVENT_FILE), "the event file is opened directly");
+	for( int b = 0; b < FLOOD; b++ )
+	{
+		for( int i = 0; i < EVENT_BLOCK; i++ )
+		{
+			g_block.session[i] = 1;
+			g_block.tick[i] = (unsigned int)(b * EVENT_BLOCK + i);
+			g_block.kind[i] = EVENT_BOUNCE;
+			g_block.object[i] = (unsigned short)(i % (MAX_BRICKS + WALL_COUNT + 2));
+			g_block.x[i] = i;
+			g_block.z[i] = -i;
+		}
+		g_block.count = EVENT_BLOCK;
+		flushEvents(g_block);
+	}
+	closeEvents();
+
+	int blocks = 0;
+	long long written = 0;
+	bool same = true;
+	FILE* file = fopen(EVENT_FILE, "rb");
+	if( file && readEventHeader(file) )
+	{
+		while( readEventBlock(file, g_next) )
+		{
+			blocks++;
+			written += g_next.count;
+			for( int i = 0; i < g_next.count; i++ )
+			{
+				if( g_next.tick[i] % EVENT_BLOCK != (unsigned int)i || g_next.object[i] != g_block.object[i] ||
+					g_next.x[i] != i || g_next.z[i] != -i )
+					same = false;
+			}
+		}
+	}
+	if( file )
+		fclose(file);
+	remove(EVENT_FILE);
+
+	printf("      %d of %d blocks written, %u events dropped\n", blocks, FLOOD, eventsDropped());
+	check(blocks >= 1 && same, "the written blocks read back whole");
+	check(written + eventsDropped() == (long long)FLOOD * EVENT_BLOCK, "every event is written or counted as dropped");
+}
+
+int main(void)
+{
+	if( !writeLevel() )
+	{
+		printf("cannot write %s\n", LEVEL_FILE);
+		return 1;
+	}
+	testRoundTrip();
+	testDrop();
+	remove(LEVEL_FILE);
+
+	if( g_failures > 0 )
+	{
+		printf("%d check(s) failed\n", g_failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,133 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoEnvTest.cpp
+//
+// Desc: Plays headless training environments (legoEnv.h) on a one-brick level and checks
+//       that the ball launched straight up destroys the brick, with one environment and
+//       with enough of them to run on the worker pool. Not part of the game project,
+//       build and run it on its own (any platform):
+//
+//           g++ -std=c++14 -O2 -pthread -I.. legoEnvTest.cpp ../legoEnv.cpp ../simulation.cpp ../events.cpp && ./a.out
+//           cl /EHsc /I.. legoEnvTest.cpp ..\legoEnv.cpp ..\simulation.cpp ..\events.cpp
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <vector>
+#include "legoEnv.h"
+
+namespace
+{
+	const char* LEVEL_FILE = "legoEnvTest.level";
+	const int   MAX_STEPS  = 600;      // ten seconds of play
+
+	int g_failures = 0;
+
+	void check(bool ok, const char* what)
+	{
+		printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+		if( !ok )
+			g_failures++;
+	}
+
+	bool writeLevel(void)
+	{
+		FILE* file = fopen(LEVEL_FILE, "w");
+		if( !file )
+			return false;
+		fprintf(file, "# one brick far up the table, straight in front of the paddle\n");
+		fprintf(file, "0 3\n");
+		fclose(file);
+		return true;
+	}
+}
+
+// every environment launches from the middle and keeps the paddle there. the
+// brick at z = 3 must go before the ball comes back: reward 1, the game done,
+// and no step that lost the ball on the way.
+void testBrickDestroyed(int count)
+{
+	LegoEnvs* envs = LegoEnvCreate(count, LEVEL_FILE);
+	check(envs != NULL, "the level file is read");
+	if( !envs )
+		return;
+
+	std::vector<LegoAction> actions(count);
+	std::vector<float> observations(count * LEGO_ENV_OBS_SIZE);
+	std::vector<float> rewards(count);
+	std::vector<unsigned char> dones(count);
+	std::vector<int> destroyedAt(count, -1);
+
+	LegoEnvReset(envs, &observations[0]);
+	bool oneBrick = true;
+	for( int e = 0; e < count; e++ )
+	{
+		const float* row = &observations[e * LEGO_ENV_OBS_SIZE];
+		if( row[LEGO_ENV_OBS_BRICKS] != 1.0f || row[LEGO_ENV_OBS_BRICKS + 1] != 0.0f )
+			oneBrick = false;
+		actions[e].paddle_x = 0.0f;
+		actions[e].launch   = 1;
+	}
+	check(oneBrick, "the level has exactly one brick");
+
+	bool lost = false;
+	for( int step = 0; step < MAX_STEPS; step++ )
+	{
+		LegoEnvStep(envs, &actions[0], &observations[0], &rewards[0], &dones[0]);
+		for( int e = 0; e < count; e++ )
+		{
+			if( destroyedAt[e] >= 0 )
+				continue;
+			if( rewards[e] < 0.0f )
+				lost = true;
+			if( rewards[e] == 1.0f && dones[e] )
+				destroyedAt[e] = step;
+		}
+	}
+	LegoEnvDestroy(envs);
+
+	int destroyed = 0;
+	for( int e = 0; e < count; e++ )
+	{
+		if( destroyedAt[e] >= 0 )
+			destroyed++;
+	}
+	printf("      %d of %d environments destroyed the brick, the first after %d steps\n",
+		destroyed, count, destroyedAt[0]);
+	check(destroyed == count, "every environment destroys the brick at z = 3");
+	check(!lost, "no ball is lost before that");
+}
+
+void testDestroyNull(void)
+{
+	LegoEnvDestroy(NULL);
+	check(true, "LegoEnvDestroy(NULL) returns");
+}
+
+void testMissingLevel(void)
+{
+	check(LegoEnvCreate(1, "no such level file") == NULL, "a missing level file fails");
+}
+
+int main(void)
+{
+	if( !writeLevel() )
+	{
+		printf("cannot write %s\n", LEVEL_FILE);
+		return 1;
+	}
+
+	testBrickDestroyed(1);
+	testBrickDestroyed(4096);
+	testDestroyNull();
+	testMissingLevel();
+	remove(LEVEL_FILE);
+
+	if( g_failures > 0 )
+	{
+		printf("%d check(s) failed\n", g_failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
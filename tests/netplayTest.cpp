@@ -0,0 +1,247 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: netplayTest.cpp
+//
+// Desc: Plays a versus game (netplay.h) between two peers over loopback on a fake clock,
+//       with the latency and loss netSimulate() adds, and checks that both sides run the
+//       same game, that an input reaches the simulation NET_INPUT_DELAY ticks after it was
+//       sampled, and that a guest whose state went wrong takes the host's over. Not part
+//       of the game project, build and run it on its own (any platform):
+//
+//           g++ -std=c++14 -O2 -pthread -I.. netplayTest.cpp ../netplay.cpp ../simulation.cpp ../events.cpp && ./a.out
+//           cl /EHsc /I.. netplayTest.cpp ..\netplay.cpp ..\simulation.cpp ..\events.cpp ws2_32.lib
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cmath>
+#include "netplay.h"
+
+namespace
+{
+	const int    FRAMES     = 600;      // ten seconds of play
+	const int    WARMUP     = 60;       // frames until both sides heard from each other
+	const int    MAX_TICKS  = 4;        // ticks one frame catches up at most, as in the game
+	const int    HISTORY    = FRAMES * MAX_TICKS;
+	unsigned short g_port   = 47810;    // every game takes the next one
+
+	int    g_failures = 0;
+	double g_now      = 0.0;
+
+	void check(bool ok, const char* what)
+	{
+		printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+		if( !ok )
+			g_failures++;
+	}
+
+	double fakeClock(void)
+	{
+		return g_now;
+	}
+
+	// one side of the game, stepped the way Display() does it
+	struct Side
+	{
+		NetPeer*     peer;
+		SimState     state;
+		FrameInput   input;
+		unsigned int due;                   // ticks the frames so far asked for
+		unsigned int hashAt[HISTORY + 1];   // hashState() after each tick
+		int          launchQueued;          // tick the launch was sampled at, -1 none
+		int          launchApplied;         // tick that started the ball, -1 not yet
+	};
+
+	Level g_level;
+	Side  g_sides[2];
+
+	void frame(Side& side)
+	{
+		netPoll(side.peer, side.state);
+		side.due++;
+		if( side.due > netTick(side.peer) + MAX_TICKS )
+			side.due = netTick(side.peer) + MAX_TICKS;
+		while( netTick(side.peer) < side.due )
+		{
+			unsigned int tick = netTick(side.peer);
+			if( netQueueInput(side.peer, side.input) )
+			{
+				if( side.input.launch )
+					side.launchQueued = (int)tick;
+				side.input.launch = false;
+			}
+			bool started = side.state.started;
+			if( !netStep(side.peer, g_level, side.state) )
+				break;
+			if( !started && side.state.started && side.launchApplied < 0 )
+				side.launchApplied = (int)tick;
+			if( tick < HISTORY )
+				side.hashAt[tick + 1] = hashState(side.state);
+		}
+		netSend(side.peer, side.state);
+	}
+
+	bool startGame(double delay, double loss)
+	{
+		char address[32];
+		g_port++;
+		sprintf(address, "127.0.0.1:%u", g_port);
+		g_sides[0].peer = netHost(g_port, fakeClock);
+		g_sides[1].peer = netJoin(address, fakeClock);
+		if( !g_sides[0].peer || !g_sides[1].peer )
+			return false;
+
+		for( int s = 0; s < 2; s++ )
+		{
+			Side& side = g_sides[s];
+			resetState(g_level, side.state);
+			side.state.versus = true;
+			side.state.session = s;             // differs between peers, as in the game
+			side.input.paddle_x = 0.0f;
+			side.input.launch = false;
+			side.due = 0;
+			side.launchQueued = -1;
+			side.launchApplied = -1;
+			side.hashAt[0] = hashState(side.state);
+			netSimulate(side.peer, delay, loss);
+		}
+		return true;
+	}
+
+	void endGame(void)
+	{
+		netClose(g_sides[0].peer);
+		netClose(g_sides[1].peer);
+	}
+
+	// both run the frames at the same time, 60 per second
+	void play(int frames)
+	{
+		for( int f = 0; f < frames; f++ )
+		{
+			// the players wiggle their paddles differently
+			double t = g_now;
+			g_sides[0].input.paddle_x = (float)(2.0 * sin(t * 3.0));
+			g_sides[1].input.paddle_x = (float)(2.5 * cos(t * 2.0));
+			frame(g_sides[0]);
+			frame(g_sides[1]);
+			g_now += NET_TICK_SECONDS;
+		}
+	}
+
+	// every tick both sides ran from first on left the same state
+	bool sameGame(unsigned int first)
+	{
+		unsigned int last = netTick(g_sides[0].peer);
+		if( netTick(g_sides[1].peer) < last )
+			last = netTick(g_sides[1].peer);
+		if( last <= first )
+			return false;
+		for( unsigned int t = first; t <= last && t <= HISTORY; t++ )
+		{
+			if( g_sides[0].hashAt[t] != g_sides[1].hashAt[t] )
+				return false;
+		}
+		return true;
+	}
+}
+
+// 25ms each way, a 50ms round trip: the inputs arrive before they are due
+void testLatency(void)
+{
+	if( !startGame(0.025, 0.0) )
+	{
+		check(false, "two peers open on loopback");
+		return;
+	}
+	play(WARMUP);
+	unsigned int stalls[2] = { netStalls(g_sides[0].peer), netStalls(g_sides[1].peer) };
+
+	g_sides[0].input.launch = true;
+	play(FRAMES - WARMUP);
+
+	printf("      %u and %u ticks, round trip %.1fms\n", netTick(g_sides[0].peer),
+		netTick(g_sides[1].peer), netRoundTrip(g_sides[0].peer) * 1000.0);
+	check(netConnected(g_sides[0].peer) && netConnected(g_sides[1].peer), "both sides connect");
+	check(netStalls(g_sides[0].peer) == stalls[0] && netStalls(g_sides[1].peer) == stalls[1],
+		"no side waits for inputs after the warmup");
+	check(fabs(netRoundTrip(g_sides[0].peer) - 0.05) < 0.002 && fabs(netRoundTrip(g_sides[1].peer) - 0.05) < 0.002,
+		"the round trip comes out at 50ms");
+	check(netLatencyOk(g_sides[0].peer) && netLatencyOk(g_sides[1].peer), "50ms round trip fits the input delay");
+	check(g_sides[0].launchQueued >= 0 && g_sides[0].launchApplied == g_sides[0].launchQueued + NET_INPUT_DELAY,
+		"the launch starts the ball NET_INPUT_DELAY ticks after it was sampled");
+	check(g_sides[1].launchApplied == g_sides[0].launchApplied, "the guest starts the ball on the same tick");
+	check(sameGame(1), "both sides run the same game");
+	check(netDesyncs(g_sides[0].peer) == 0 && netDesyncs(g_sides[1].peer) == 0, "no hash differs");
+	endGame();
+}
+
+// the redundant inputs cover lost packets
+void testLoss(void)
+{
+	if( !startGame(0.025, 0.1) )
+	{
+		check(false, "two peers open on loopback");
+		return;
+	}
+	g_sides[0].input.launch = true;
+	play(FRAMES);
+	check(netTick(g_sides[0].peer) > FRAMES / 2 && netTick(g_sides[1].peer) > FRAMES / 2,
+		"the game goes on with 10% loss");
+	check(sameGame(1), "both sides run the same game with 10% loss");
+	check(netDesyncs(g_sides[0].peer) == 0 && netDesyncs(g_sides[1].peer) == 0, "no hash differs with 10% loss");
+	endGame();
+}
+
+// a guest that went wrong takes over the host's state
+void testResync(void)
+{
+	if( !startGame(0.025, 0.0) )
+	{
+		check(false, "two peers open on loopback");
+		return;
+	}
+	g_sides[0].input.launch = true;
+	play(WARMUP * 2);
+	unsigned int broken = netTick(g_sides[1].peer);
+	g_sides[1].state.alive[0] ^= 1;
+	play(FRAMES - WARMUP * 2);
+
+	check(netDesyncs(g_sides[1].peer) > 0, "the guest notices its hash differs");
+	check(netResyncs(g_sides[1].peer) > 0, "the guest takes over the host's state");
+	check(sameGame(broken + NET_HASH_INTERVAL * 4), "both sides run the same game again");
+	endGame();
+}
+
+// 60ms each way does not fit into two ticks
+void testTooFar(void)
+{
+	if( !startGame(0.06, 0.0) )
+	{
+		check(false, "two peers open on loopback");
+		return;
+	}
+	play(FRAMES);
+	printf("      round trip %.1fms\n", netRoundTrip(g_sides[0].peer) * 1000.0);
+	check(!netLatencyOk(g_sides[0].peer) && !netLatencyOk(g_sides[1].peer), "a 120ms round trip fails the latency check");
+	check(sameGame(1), "both sides still run the same game, only slower");
+	endGame();
+}
+
+int main(void)
+{
+	defaultLevel(g_level);
+
+	testLatency();
+	testLoss();
+	testResync();
+	testTooFar();
+
+	if( g_failures > 0 )
+	{
+		printf("%d check(s) failed\n", g_failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,226 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+// File: pacingTest.cpp
+//
+// Desc: Checks FramePacer against a fake clock: how far frames start from their deadline,
+//       and how much of the waiting is sleeping rather than spinning. Feeds QualityGovernor
+//       made-up frame times and checks when it changes the level. Not part of the game
+//       project, build and run it on its own (any platform):
+//
+//           g++ -std=c++14 -O2 -I.. pacingTest.cpp ../pacing.cpp && ./a.out
+//           cl /EHsc /I.. pacingTest.cpp ..\pacing.cpp
+//          
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cmath>
+#include "pacing.h"
+
+namespace
+{
+	const double CLOCK_COST = 0.000001;    // every clock read takes 1us, so a spin takes time
+
+	double   g_now      = 0.0;
+	double   g_slept    = 0.0;             // time spent inside sleep()
+	unsigned g_random   = 12345;
+	bool     g_sleepCalled = false;
+
+	double fakeClock(void)
+	{
+		g_now += CLOCK_COST;
+		return g_now;
+	}
+
+	// like Sleep() after timeBeginPeriod(1): whole milliseconds, then up to 1ms late
+	void fakeSleep(double sec)
+	{
+		g_random = g_random * 1103515245u + 12345u;
+		double late = ((g_random >> 16) & 0x7fff) / 32768.0 * 0.001;
+		double actual = std::floor(sec * 1000.0) / 1000.0 + late;
+		g_now   += actual;
+		g_slept += actual;
+		g_sleepCalled = true;
+	}
+
+	void work(double sec)
+	{
+		g_now += sec;
+	}
+
+	int g_failures = 0;
+
+	void check(bool ok, const char* what)
+	{
+		printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+		if( !ok )
+			g_failures++;
+	}
+}
+
+// 600 frames at 60 fps with 5ms of work each: every frame starts within a few
+// clock reads of its deadline, the error does not add up, and most of the
+// waiting is done asleep.
+void testSteadyRate(void)
+{
+	const double period = 1.0 / 60.0;
+	d3d::FramePacer pacer(60.0, fakeClock, fakeSleep);
+
+	pacer.waitNextFrame();      // the first frame is due at once
+	double first = g_now;
+	double waited = 0.0, maxError = 0.0;
+	g_slept = 0.0;
+	for( int frame = 1; frame <= 600; frame++ )
+	{
+		work(0.005);
+		double before = g_now;
+		pacer.waitNextFrame();
+		waited += g_now - before;
+
+		double error = std::fabs(g_now - (first + frame * period));
+		if( error > maxError )
+			maxError = error;
+	}
+
+	double sleepShare = g_slept / waited;
+	printf("      max deadline error %.1fus, sleeping %.1f%%, spinning %.1f%% of %.0fms waited\n",
+		maxError * 1e6, sleepShare * 100.0, (1.0 - sleepShare) * 100.0, waited * 1000.0);
+	check(maxError < 0.00005, "frames start within 50us of their deadline");
+	check(sleepShare > 0.8, "more than 80% of the wait is asleep");
+}
+
+// after a long stall the next frame comes at once, and the ones after it go
+// back to the normal rate instead of rushing to catch up
+void testStall(void)
+{
+	const double period = 1.0 / 60.0;
+	d3d::FramePacer pacer(60.0, fakeClock, fakeSleep);
+
+	pacer.waitNextFrame();
+	work(0.1);
+	double elapsed = pacer.waitNextFrame();
+	check(elapsed > 0.1 && elapsed < 0.1 + 0.0001, "the frame after a stall is not delayed");
+
+	bool steady = true;
+	for( int frame = 0; frame < 10; frame++ )
+	{
+		elapsed = pacer.waitNextFrame();
+		if( std::fabs(elapsed - period) > 0.00005 )
+			steady = false;
+	}
+	check(steady, "no burst of short frames after a stall");
+}
+
+// 0 fps: no waiting at all
+void testUnlimited(void)
+{
+	d3d::FramePacer pacer(0.0, fakeClock, fakeSleep);
+
+	g_sleepCalled = false;
+	double before = g_now;
+	for( int frame = 0; frame < 100; frame++ )
+		pacer.waitNextFrame();
+	check(!g_sleepCalled && g_now - before < 0.001, "unlimited rate never sleeps or spins");
+}
+
+namespace
+{
+	const int    LEVELS = 4;
+	const double BUDGET = 1000.0 / 60.0;
+
+	// feeds frames of frameMs until the level changes or frames run out, returns how many it fed
+	int feedUntilChange(d3d::QualityGovernor& governor, double frameMs, int frames)
+	{
+		int level = governor.level();
+		for( int frame = 1; frame <= frames; frame++ )
+		{
+			if( governor.update(frameMs) != level )
+				return frame;
+		}
+		return frames;
+	}
+}
+
+// frames far over budget: one level down after GOVERNOR_DOWN_AFTER of them,
+// then the next one only after the hold, down to the cheapest level
+void testGovernorDown(void)
+{
+	d3d::QualityGovernor governor(LEVELS, BUDGET);
+	feedUntilChange(governor, BUDGET * 0.7, d3d::GOVERNOR_HOLD * 2);
+	check(governor.level() == LEVELS - 1, "frames inside the budget keep the best level");
+
+	int frames = feedUntilChange(governor, BUDGET * 5.0, d3d::GOVERNOR_DOWN_AFTER * 2);
+	check(frames == d3d::GOVERNOR_DOWN_AFTER && governor.level() == LEVELS - 2,
+		"sustained over-budget frames step down after GOVERNOR_DOWN_AFTER");
+
+	frames = feedUntilChange(governor, BUDGET * 5.0, d3d::GOVERNOR_HOLD * 2);
+	check(frames == d3d::GOVERNOR_HOLD + 1 && governor.level() == LEVELS - 3, "the next step down waits for the hold");
+
+	feedUntilChange(governor, BUDGET * 5.0, d3d::GOVERNOR_HOLD * 2);
+	feedUntilChange(governor, BUDGET * 5.0, d3d::GOVERNOR_HOLD * 2);
+	check(governor.level() == 0, "over-budget frames end at the cheapest level and stay there");
+}
+
+// a cheap trace climbs back one level at a time, each step after
+// GOVERNOR_UP_AFTER frames and never inside the hold
+void testGovernorUp(void)
+{
+	d3d::QualityGovernor governor(LEVELS, BUDGET);
+	governor.reset(0);
+
+	bool spaced = true;
+	for( int level = 1; level < LEVELS; level++ )
+	{
+		int frames = feedUntilChange(governor, BUDGET * 0.2, d3d::GOVERNOR_UP_AFTER * 2);
+		if( frames < d3d::GOVERNOR_UP_AFTER || frames <= d3d::GOVERNOR_HOLD || governor.level() != level )
+			spaced = false;
+	}
+	check(spaced, "cheap frames step up after GOVERNOR_UP_AFTER and the hold");
+	check(governor.level() == LEVELS - 1, "cheap frames climb back to the best level");
+
+	int frames = feedUntilChange(governor, BUDGET * 0.2, d3d::GOVERNOR_UP_AFTER * 4);
+	check(frames == d3d::GOVERNOR_UP_AFTER * 4 && governor.level() == LEVELS - 1, "the best level is the top");
+}
+
+// frames that jump around the budget, every other one over it: the level the
+// average fits in is found once and kept, without going back and forth
+void testGovernorNoFlap(void)
+{
+	// what a frame costs at each level, the best one is over budget
+	const double cost[LEVELS] = { BUDGET * 0.35, BUDGET * 0.55, BUDGET * 0.75, BUDGET * 1.1 };
+
+	d3d::QualityGovernor governor(LEVELS, BUDGET);
+	int changes = 0, ups = 0;
+	int level = governor.level();
+	for( int frame = 0; frame < 3600; frame++ )
+	{
+		double jitter = (frame & 1) ? 1.4 : 0.6;
+		int next = governor.update(cost[level] * jitter);
+		if( next != level )
+		{
+			changes++;
+			if( next > level )
+				ups++;
+		}
+		level = next;
+	}
+	printf("      %d level changes over 3600 frames, ended at level %d\n", changes, level);
+	check(changes == 1 && ups == 0 && level == LEVELS - 2, "frames oscillating around the budget do not flap");
+}
+
+int main(void)
+{
+	testSteadyRate();
+	testStall();
+	testUnlimited();
+	testGovernorDown();
+	testGovernorUp();
+	testGovernorNoFlap();
+
+	if( g_failures > 0 )
+	{
+		printf("%d check(s) failed\n", g_failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
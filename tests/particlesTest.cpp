@@ -0,0 +1,106 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: particlesTest.cpp
+//
+// Desc: Checks ParticlePool (particles.h): the limit caps a burst, gravity pulls the
+//       particles down, none falls through the floor, all retire when their life runs
+//       out, and a lower limit drops the extra ones. Then times update() on a full pool
+//       of 500k particles. Not part of the game project, build and run it on its own
+//       (any platform):
+//
+//           g++ -std=c++14 -O3 -I.. particlesTest.cpp ../particles.cpp && ./a.out
+//           cl /EHsc /O2 /I.. particlesTest.cpp ..\particles.cpp
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <chrono>
+#include "particles.h"
+
+namespace
+{
+	const float FRAME  = 1.0f / 60.0f;
+	const int   FRAMES = 100;
+	const unsigned int YELLOW = 0xffffff00;
+
+	ParticlePool g_pool;        // about 16MB, too big for the stack
+
+	int g_failures = 0;
+
+	void check(bool ok, const char* what)
+	{
+		printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+		if( !ok )
+			g_failures++;
+	}
+}
+
+// a burst larger than the limit fills the pool up to it and no further
+void testLimit(void)
+{
+	g_pool.clear();
+	g_pool.setLimit(1000);
+	g_pool.emit(0.0f, 0.1f, 0.0f, 800, 1.0f, 1.5f, YELLOW);
+	g_pool.emit(0.0f, 0.1f, 0.0f, 800, 1.0f, 1.5f, YELLOW);
+	check(g_pool.getCount() == 1000, "the limit caps the particles of a burst");
+
+	g_pool.setLimit(300);
+	check(g_pool.getCount() == 300 && g_pool.getLimit() == 300, "a lower limit drops the extra particles");
+	g_pool.setLimit(ParticlePool::CAPACITY + 1);
+	check(g_pool.getLimit() == ParticlePool::CAPACITY, "the limit is at most CAPACITY");
+}
+
+// the particles fly up, fall back, bounce on the floor and all retire
+void testMotion(void)
+{
+	g_pool.clear();
+	g_pool.emit(0.0f, 0.1f, 0.0f, 1000, 1.0f, 1.5f, YELLOW);
+
+	float before = g_pool.getVY()[0];
+	g_pool.update(FRAME);
+	check(g_pool.getVY()[0] < before, "gravity lowers the vertical speed");
+
+	bool above = true;
+	for( int f = 0; f < 90 && g_pool.getCount() > 0; f++ )
+	{
+		g_pool.update(FRAME);
+		for( int i = 0; i < g_pool.getCount(); i++ )
+		{
+			if( g_pool.getY()[i] < 0.0f )
+				above = false;
+		}
+	}
+	check(above, "no particle falls through the floor");
+	check(g_pool.getCount() == 0, "every particle retires after its life");
+}
+
+// update() of a full pool, whose particles live longer than the run
+void benchmark(void)
+{
+	g_pool.clear();
+	g_pool.setLimit(ParticlePool::CAPACITY);
+	g_pool.emit(0.0f, 0.1f, 0.0f, ParticlePool::CAPACITY, 1.0f, 1000.0f, YELLOW);
+	check(g_pool.getCount() == ParticlePool::CAPACITY, "the pool holds 500k particles");
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for( int f = 0; f < FRAMES; f++ )
+		g_pool.update(FRAME);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("      %d particles: %.3fms per update\n", g_pool.getCount(), ms / FRAMES);
+	check(g_pool.getCount() == ParticlePool::CAPACITY, "none of them retires early");
+}
+
+int main(void)
+{
+	testLimit();
+	testMotion();
+	benchmark();
+
+	if( g_failures > 0 )
+	{
+		printf("%d check(s) failed\n", g_failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,221 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simulationTest.cpp
+//
+// Desc: Checks that advanceWorld() (simulation.h) moves the balls the same way whatever
+//       the step: ten advances of one frame end where one advance of ten frames does,
+//       with and without friction, and when a ball comes to rest inside the interval.
+//       Also reads a level longer than MAX_BRICKS and checks the alive bits past the
+//       first word, and which strips are resident as the ball and the view move. Not
+//       part of the game project, build and run it on its own (any platform):
+//
+//           g++ -std=c++14 -O2 -I.. simulationTest.cpp ../simulation.cpp ../events.cpp && ./a.out
+//           cl /EHsc /I.. simulationTest.cpp ..\simulation.cpp ..\events.cpp
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cmath>
+#include <cfloat>
+#include "simulation.h"
+
+namespace
+{
+	const char* LEVEL_FILE = "simulationTest.level";
+	const int   FRAMES    = 10;
+	const float TOLERANCE = 1e-4f;     // float rounding of ten steps against one
+
+	int g_failures = 0;
+
+	void check(bool ok, const char* what)
+	{
+		printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+		if( !ok )
+			g_failures++;
+	}
+
+	bool near(float a, float b)
+	{
+		return std::fabs(a - b) <= TOLERANCE * (1.0f + std::fabs(b));
+	}
+
+	bool sameBall(const BallState& a, const BallState& b)
+	{
+		return near(a.x, b.x) && near(a.z, b.z) && near(a.vx, b.vx) && near(a.vz, b.vz);
+	}
+
+	// a game in play: the ball flies up and to the side, the paddle drifts
+	SimState moving(float ballSpeed)
+	{
+		Level level;
+		SimState state;
+		defaultLevel(level);
+		resetState(level, state);
+		state.started = true;
+		state.ball.vx = ballSpeed * 0.6f;
+		state.ball.vz = ballSpeed * 0.8f;
+		state.paddle.vx = 0.5f;
+		return state;
+	}
+
+	// advances state once by FRAMES frames and, on a copy, FRAMES times by one
+	// frame. returns whether both end at the same place and speed.
+	bool sameAdvance(const SimState& start, float frame, SimState* stepped)
+	{
+		SimState whole = start;
+		advanceWorld(whole, frame * FRAMES);
+		*stepped = start;
+		for( int f = 0; f < FRAMES; f++ )
+			advanceWorld(*stepped, frame);
+		printf("      ball (%.5f, %.5f) v (%.5f, %.5f) in one step, (%.5f, %.5f) v (%.5f, %.5f) in %d\n",
+			whole.ball.x, whole.ball.z, whole.ball.vx, whole.ball.vz,
+			stepped->ball.x, stepped->ball.z, stepped->ball.vx, stepped->ball.vz, FRAMES);
+		return sameBall(whole.ball, stepped->ball) && sameBall(whole.paddle, stepped->paddle);
+	}
+}
+
+// without friction the balls keep their speed and never stop
+void testNoFriction(void)
+{
+	g_tuning.friction = 0.0f;
+	SimState start = moving(g_tuning.launch_speed), stepped;
+	check(timeToStop(start.ball, ballDamping()) == FLT_MAX, "without friction a ball never stops");
+	check(sameAdvance(start, SIM_STEP, &stepped), "without friction ten 1-frame advances match one 10-frame advance");
+	check(near(stepped.ball.x, start.ball.x + start.ball.vx * g_tuning.time_scale * SIM_STEP * FRAMES),
+		"without friction the ball moves in a straight line at its speed");
+}
+
+// with friction the speed decays, nobody stops within the interval
+void testFriction(void)
+{
+	g_tuning.friction = 1.0f;
+	SimState start = moving(g_tuning.launch_speed), stepped;
+	check(timeToRest(start) > SIM_STEP * FRAMES, "the launched ball moves for more than ten frames");
+	check(sameAdvance(start, SIM_STEP, &stepped), "with friction ten 1-frame advances match one 10-frame advance");
+	float kept = (float)pow(DECREASE_RATE, FRAMES);
+	check(near(stepped.ball.vz, start.ball.vz * kept), "with friction the ball keeps DECREASE_RATE of its speed per frame");
+}
+
+// frames of five seconds; the ball comes to rest in the middle of the seventh
+void testStop(void)
+{
+	g_tuning.friction = 1.0f;
+	const float frame = SIM_STEP * 300;
+	float speed = (float)(STOP_SPEED / pow(DECREASE_RATE, 300 * 6.5));
+	SimState start = moving(speed / 0.8f), stepped;
+	start.paddle.vx = 0.0f;
+	double stop = timeToStop(start.ball, ballDamping());
+	check(stop > frame * 6 && stop < frame * 7, "the ball stops inside the seventh frame");
+	check(timeToRest(start) == stop, "the paddle at rest does not lengthen timeToRest()");
+
+	check(sameAdvance(start, frame, &stepped), "ten 1-frame advances match one 10-frame advance across the stop");
+	check(stepped.ball.vx == 0.0f && stepped.ball.vz == 0.0f && timeToRest(stepped) == 0.0,
+		"the ball is at rest after the stop");
+
+	// one advance of timeToStop() lands where the ball rests (its speed may be a
+	// hair over STOP_SPEED when the float timeDelta rounds down)
+	SimState once = start;
+	advanceWorld(once, (float)stop);
+	check(near(once.ball.x, stepped.ball.x) && near(once.ball.z, stepped.ball.z),
+		"advancing by timeToStop() ends where the ball rests");
+}
+
+// a level file with more bricks than fit: the first MAX_BRICKS are used, and
+// the count of the whole file tells the caller it was cut off
+void testLevelLimit(void)
+{
+	FILE* file = fopen(LEVEL_FILE, "w");
+	if( !file )
+	{
+		check(false, "the level file is written");
+		return;
+	}
+	fprintf(file, "# a grid of bricks, more than MAX_BRICKS\n");
+	for( int i = 0; i < MAX_BRICKS + 5; i++ )
+		fprintf(file, "%.2f %.2f\n", -3.0f + (i % 15) * 0.42f, -3.0f + (i / 15) * 0.42f);
+	fclose(file);
+
+	Level level;
+	int listed = 0;
+	level.count = readLevel(LEVEL_FILE, level.pos, &listed);
+	remove(LEVEL_FILE);
+	check(level.count == MAX_BRICKS && listed == MAX_BRICKS + 5, "readLevel() stops at MAX_BRICKS and counts the rest");
+	check(std::fabs(level.pos[MAX_BRICKS - 1][0] - (-3.0f + ((MAX_BRICKS - 1) % 15) * 0.42f)) < 0.01f, "the last brick that fits is read");
+	buildChunks(level);
+
+	SimState state;
+	resetState(level, state);
+	check(countBricks(state) == MAX_BRICKS && brickAlive(state, MAX_BRICKS - 1), "every brick of a full level starts alive");
+
+	unsigned int hash = hashState(state);
+	setBrickAlive(state, 100, false);
+	check(!brickAlive(state, 100) && brickAlive(state, 99) && brickAlive(state, 101) &&
+		countBricks(state) == MAX_BRICKS - 1, "a brick past the first word breaks alone");
+	check(hashState(state) != hash, "the hash covers every alive word");
+
+	level.count = 40;
+	resetState(level, state);
+	check(countBricks(state) == 40 && brickAlive(state, 39) && !brickAlive(state, 40), "a level of 40 bricks starts 40 alive");
+}
+
+// the strips around the ball and those in view are resident, their bricks
+// and no others are listed, and strips come and go as the ball moves
+void testResidency(void)
+{
+	Level level;
+	level.count = CHUNK_COUNT;
+	for( int c = 0; c < CHUNK_COUNT; c++ )
+	{
+		level.pos[c][0] = 0.0f;
+		level.pos[c][1] = TABLE_NEAR_Z + (c + 0.5f) * CHUNK_DEPTH;     // one brick per strip
+	}
+	buildChunks(level);
+
+	SimState state;
+	resetState(level, state);
+	state.ball.z = TABLE_NEAR_Z + 0.5f * CHUNK_DEPTH;              // in the first strip
+
+	bool seen[CHUNK_COUNT] = { false };
+	seen[CHUNK_COUNT - 1] = true;                                   // the camera looks at the far end
+	Residency residency;
+	clearResidency(residency);
+	updateResidency(level, state, seen, residency);
+
+	bool listed = residency.count == RESIDENT_REACH + 2;
+	for( int k = 0; k < residency.count; k++ )
+	{
+		int brick = residency.bricks[k];
+		if( brick > RESIDENT_REACH && brick != CHUNK_COUNT - 1 )
+			listed = false;
+	}
+	check(residency.resident[0] && residency.resident[RESIDENT_REACH] && !residency.resident[RESIDENT_REACH + 1] &&
+		residency.resident[CHUNK_COUNT - 1], "the strips around the ball and in view are resident");
+	check(listed, "only the bricks of resident strips are listed");
+	check(residency.loaded == RESIDENT_REACH + 2 && residency.evicted == 0, "the first update loads every resident strip");
+
+	state.ball.z += CHUNK_DEPTH;
+	updateResidency(level, state, seen, residency);
+	check(residency.loaded == 1 && residency.evicted == 0 && residency.resident[RESIDENT_REACH + 1],
+		"one strip comes in when the ball moves up one");
+	state.ball.z += CHUNK_DEPTH * 2;
+	updateResidency(level, state, seen, residency);
+	check(residency.loaded == 2 && residency.evicted == 2 && !residency.resident[0] && !residency.resident[1],
+		"the strips the ball left go out");
+}
+
+int main(void)
+{
+	testNoFriction();
+	testFriction();
+	testStop();
+	testLevelLimit();
+	testResidency();
+
+	if( g_failures > 0 )
+	{
+		printf("%d check(s) failed\n", g_failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
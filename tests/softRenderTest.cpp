@@ -0,0 +1,195 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: softRenderTest.cpp
+//
+// Desc: Renders the default board with the CPU renderer (softRender.h) at the game's
+//       1024x768 and checks what lands where: the background, the ball, the paddle, a
+//       brick and the table, the wireframe mode, that the image does not depend on the
+//       number of threads, and the image files. Prints the time per frame. Not part of
+//       the game project, build and run it on its own (any platform):
+//
+//           g++ -std=c++14 -O3 -pthread -I.. softRenderTest.cpp ../softRender.cpp ../simulation.cpp ../events.cpp && ./a.out
+//           cl /EHsc /O2 /I.. softRenderTest.cpp ..\softRender.cpp ..\simulation.cpp ..\events.cpp
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include "softRender.h"
+
+namespace
+{
+	const int WIDTH  = 1024;
+	const int HEIGHT = 768;
+	const int SLICES = 50;      // sphere detail of the best quality level
+	const int FRAMES = 20;
+
+	int g_failures = 0;
+
+	void check(bool ok, const char* what)
+	{
+		printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+		if( !ok )
+			g_failures++;
+	}
+
+	int red(unsigned int c)   { return (c >> 16) & 0xff; }
+	int green(unsigned int c) { return (c >> 8) & 0xff; }
+	int blue(unsigned int c)  { return c & 0xff; }
+
+	// the pixel a point of the world lands on
+	unsigned int pixelAt(const SoftRenderer& renderer, float x, float y, float z)
+	{
+		float point[3] = { x, y, z };
+		float sx, sy;
+		if( !renderer.project(point, &sx, &sy) )
+			return 0xffffffff;
+		int px = (int)(sx + 0.5f), py = (int)(sy + 0.5f);
+		if( px < 0 || py < 0 || px >= renderer.getWidth() || py >= renderer.getHeight() )
+			return 0xffffffff;
+		return renderer.getPixel(px, py);
+	}
+
+	int countColor(const SoftRenderer& renderer, unsigned int color)
+	{
+		int count = 0;
+		for( int i = 0; i < renderer.getWidth() * renderer.getHeight(); i++ )
+		{
+			if( renderer.getPixels()[i] == color )
+				count++;
+		}
+		return count;
+	}
+
+	double renderBoard(SoftRenderer& renderer, const SoftBoard& board, const Level& level, const SimState& state, bool wire)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		renderer.setWireframe(wire);
+		drawBoard(renderer, board, level, state);
+		renderer.render();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void testMeshes(void)
+{
+	SoftMesh mesh;
+	softSphere(mesh, 1.0f, 10, 8);
+	check(mesh.positions.size() == (10 * 7 + 2) * 3 && mesh.indices.size() == 2 * 10 * 7 * 3,
+		"a sphere has the vertices and triangles of D3DXCreateSphere()");
+	softBox(mesh, 1.0f, 2.0f, 3.0f);
+	check(mesh.positions.size() == 24 * 3 && mesh.indices.size() == 12 * 3, "a box has 24 vertices and 12 triangles");
+}
+
+void testBoard(const Level& level, const SimState& state, const SoftBoard& board)
+{
+	SoftRenderer renderer(WIDTH, HEIGHT, 1);
+	renderBoard(renderer, board, level, state, false);
+
+	unsigned int ball = pixelAt(renderer, state.ball.x, BALL_Y, state.ball.z);
+	unsigned int paddle = pixelAt(renderer, state.paddle.x, BALL_Y + g_tuning.radius * 0.5f, state.paddle.z);
+	unsigned int brick = pixelAt(renderer, level.pos[0][0], g_tuning.radius, level.pos[0][1]);
+	unsigned int table = pixelAt(renderer, 2.0f, TABLE_Y + TABLE_HEIGHT / 2, -4.3f);
+	printf("      ball %06x, paddle %06x, brick %06x, table %06x\n", ball, paddle, brick, table);
+
+	check(renderer.getPixel(0, 0) == CLEAR_COLOR, "the corner shows the background");
+	check(red(ball) > 40 && green(ball) < red(ball) / 4 && blue(ball) < red(ball) / 4, "the ball is red and in front of the table");
+	check(red(paddle) > 40 && red(paddle) == green(paddle) && green(paddle) == blue(paddle), "the paddle is white");
+	check(red(brick) > 40 && red(brick) == green(brick) && blue(brick) < red(brick) / 4, "a brick is yellow");
+	check(green(table) > 40 && red(table) == 0 && blue(table) == 0, "the table is green");
+
+	// the same frame on more threads
+	SoftRenderer threaded(WIDTH, HEIGHT, 4);
+	renderBoard(threaded, board, level, state, false);
+	check(memcmp(renderer.getPixels(), threaded.getPixels(), WIDTH * HEIGHT * sizeof(unsigned int)) == 0,
+		"4 threads render the same image as 1");
+
+	// a new state moves the ball
+	SimState moved = state;
+	moved.ball.x += 1.0f;
+	renderBoard(renderer, board, level, moved, false);
+	unsigned int old = pixelAt(renderer, state.ball.x - 0.1f, BALL_Y, state.ball.z);
+	check(!(red(old) > 40 && green(old) < red(old) / 4 && blue(old) < red(old) / 4), "the next frame shows the ball where it moved");
+
+	int background = countColor(renderer, CLEAR_COLOR);
+	renderBoard(renderer, board, level, state, true);
+	int wireBackground = countColor(renderer, CLEAR_COLOR);
+	printf("      background pixels: %d filled, %d wireframe\n", background, wireBackground);
+	check(wireBackground > background + WIDTH * HEIGHT / 4, "the wireframe leaves the faces empty");
+}
+
+void testFiles(const Level& level, const SimState& state, const SoftBoard& board)
+{
+	SoftRenderer renderer(64, 48, 1);
+	renderBoard(renderer, board, level, state, false);
+
+	check(renderer.save("softRenderTest.ppm"), "the PPM is written");
+	FILE* file = fopen("softRenderTest.ppm", "rb");
+	int width = 0, height = 0, depth = 0;
+	unsigned char rgb[3] = { 0, 0, 0 };
+	bool read = file && fscanf(file, "P6 %d %d %d", &width, &height, &depth) == 3 &&
+		fgetc(file) == '\n' && fread(rgb, 1, 3, file) == 3;
+	if( file )
+		fclose(file);
+	unsigned int first = renderer.getPixel(0, 0);
+	check(read && width == 64 && height == 48 && depth == 255 &&
+		rgb[0] == red(first) && rgb[1] == green(first) && rgb[2] == blue(first), "the PPM reads back");
+
+	check(renderer.save("softRenderTest.png"), "the PNG is written");
+	file = fopen("softRenderTest.png", "rb");
+	unsigned char head[8] = { 0 };
+	long size = 0;
+	if( file )
+	{
+		read = fread(head, 1, 8, file) == 8;
+		fseek(file, 0, SEEK_END);
+		size = ftell(file);
+		fclose(file);
+	}
+	// signature, IHDR, IDAT with one stored block, IEND
+	long expected = 8 + 25 + (12 + 2 + 5 + (64 * 3 + 1) * 48 + 4) + 12;
+	check(read && memcmp(head, "\x89PNG\r\n\x1a\n", 8) == 0 && size == expected, "the PNG has the expected layout");
+	remove("softRenderTest.ppm");
+	remove("softRenderTest.png");
+}
+
+void benchmark(const Level& level, const SimState& state, const SoftBoard& board)
+{
+	int cores = (int)std::thread::hardware_concurrency();
+	int counts[2] = { 1, cores > 1 ? cores : 1 };
+	for( int k = 0; k < (counts[1] > 1 ? 2 : 1); k++ )
+	{
+		SoftRenderer renderer(WIDTH, HEIGHT, counts[k]);
+		renderBoard(renderer, board, level, state, false);  // the buffers grow on the first frame
+		double total = 0;
+		for( int f = 0; f < FRAMES; f++ )
+			total += renderBoard(renderer, board, level, state, false);
+		printf("      %dx%d, %d thread(s): %.2fms per frame\n", WIDTH, HEIGHT, counts[k], total / FRAMES);
+	}
+}
+
+int main(void)
+{
+	Level level;
+	SimState state;
+	SoftBoard board;
+	defaultLevel(level);
+	buildChunks(level);
+	resetState(level, state);
+	buildBoard(board, g_tuning.radius, SLICES);
+
+	testMeshes();
+	testBoard(level, state, board);
+	testFiles(level, state, board);
+	benchmark(level, state, board);
+
+	if( g_failures > 0 )
+	{
+		printf("%d check(s) failed\n", g_failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
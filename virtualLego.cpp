@@ -11,11 +11,24 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "d3dUtility.h"
+#include "telemetry.h"
+#include "simulation.h"
+#include "events.h"
+#include "legoEnv.h"
+#include "netplay.h"
+#include "softRender.h"
+#include "particles.h"
 #include <vector>
 #include <ctime>
 #include <cstdlib>
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
+#include <climits>
+#include <new>
+#include <thread>
+#include <type_traits>
 
 IDirect3DDevice9* Device = NULL;
 
@@ -23,10 +36,6 @@ IDirect3DDevice9* Device = NULL;
 const int Width = 1024;
 const int Height = 768;
 
-const float spherePos[6][2] = { {-2.0f, 0} , {0.0f,0} , {2.0f,0}, {-2.3f, 1.0f}, {0.0f, 1.0f}, {2.3f, 1.0f} };
-// initialize the color of each ball
-const D3DXCOLOR sphereColor[6] = { d3d::YELLOW, d3d::YELLOW, d3d::YELLOW, d3d::YELLOW,d3d::YELLOW,d3d::YELLOW };
-
 // -----------------------------------------------------------------------------
 // Transform matrices
 // -----------------------------------------------------------------------------
@@ -34,36 +43,53 @@ D3DXMATRIX g_mWorld;
 D3DXMATRIX g_mView;
 D3DXMATRIX g_mProj;
 
-#define M_RADIUS 0.21   // ball radius
 #define PI 3.14159265
 #define M_HEIGHT 0.01
-#define DECREASE_RATE 0.9982
+
+// -----------------------------------------------------------------------------
+// Heap allocation counter (debug build only)
+// every object of the game is created in Setup(), so a frame in the middle of
+// play must not touch the heap. Display() asserts this on every frame.
+// every thread counts its own allocations: env workers, the event writer and
+// the solver threads may allocate while a frame runs without the render thread
+// doing so, and each thread increments only its own counter.
+// -----------------------------------------------------------------------------
+#ifdef _DEBUG
+static thread_local long g_allocCount = 0;
+
+void* operator new(size_t size)
+{
+    ++g_allocCount;
+    void* p = malloc(size ? size : 1);
+    if (NULL == p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+#endif
 
 // -----------------------------------------------------------------------------
 // CSphere class definition
+// draws a ball. where the balls are and how fast they go is kept in SimState;
+// the game copies the positions over before drawing (see placeBalls()).
 // -----------------------------------------------------------------------------
 
 class CSphere {
 private:
     float               center_x, center_y, center_z;
-    float                   m_radius;
-    float               m_velocity_x;
-    float               m_velocity_z;
-    bool ball_exist = true;
-    int ball_color; // 0 -  1 -  2 - 
-    float pre_center_x, pre_center_z;
 
 public:
     CSphere(void)
     {
         D3DXMatrixIdentity(&m_mLocal);
         ZeroMemory(&m_mtrl, sizeof(m_mtrl));
-        m_radius = 0;
-        m_velocity_x = 0;
-        m_velocity_z = 0;
+        center_x = center_y = center_z = 0;
         m_pSphereMesh = NULL;
     }
-    ~CSphere(void) {}
 
 public:
     bool create(IDirect3DDevice9* pDevice, D3DXCOLOR color = d3d::WHITE)
@@ -77,20 +103,35 @@ public:
         m_mtrl.Emissive = d3d::BLACK;
         m_mtrl.Power = 5.0f;
 
-        if (FAILED(D3DXCreateSphere(pDevice, getRadius(), 50, 50, &m_pSphereMesh, NULL)))
-            return false;
-        return true;
+        return acquireMesh(pDevice);
     }
 
     void destroy(void)
     {
         if (m_pSphereMesh != NULL) {
-            m_pSphereMesh->Release();
+            releaseMesh(m_pSphereMesh);
             m_pSphereMesh = NULL;
-            this->ball_exist = false;
         }
     }
 
+    // number of slices and stacks of the sphere mesh. takes effect for each
+    // ball on its next reloadMesh().
+    static void setDetail(int slices) { s_slices = slices; }
+
+    // drops this ball's mesh and takes the current shared one, e.g. after the radius changed
+    bool reloadMesh(IDirect3DDevice9* pDevice)
+    {
+        ID3DXMesh* old = m_pSphereMesh;
+        m_pSphereMesh = NULL;
+        if (!acquireMesh(pDevice)) {
+            m_pSphereMesh = old;
+            return false;
+        }
+        if (old != NULL)
+            releaseMesh(old);
+        return true;
+    }
+
     void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
     {
         if (NULL == pDevice)
@@ -101,73 +142,6 @@ public:
         m_pSphereMesh->DrawSubset(0);
     }
 
-    // 㫉 Ȯ
-    bool hasIntersected(CSphere& ball)
-    {
-        D3DXVECTOR3 position_this = this->getCenter();
-        D3DXVECTOR3 position_other = ball.getCenter();
-        double xDistance = abs((position_this.x - position_other.x) * (position_this.x - position_other.x));
-        double zDistance = abs((position_this.z - position_other.z) * (position_this.z - position_other.z));
-        double totalDistance = sqrt(xDistance + zDistance);
-        if (totalDistance < (this->getRadius() + ball.getRadius()))
-        {
-            return true;
-        }
-        return false;
-    }
-
-    void hitBy(CSphere& ball)
-    {
-        if (this->hasIntersected(ball))
-        {
-            adjustPosition(ball);
-            //  ε° 
-            float dx = ball.getCenter().x - this->getCenter().x;
-            float dz = ball.getCenter().z - this->getCenter().z;
-            float distance = sqrt(dx * dx + dz * dz);
-
-            float bvx = ball.m_velocity_x; 
-            float bvz = ball.m_velocity_z;
-
-            float velocity = sqrt(bvx * bvx + bvz * bvz);
-            float dt = velocity / distance;
-            ball.setPower(dx * dt, dz * dt);
-
-            if (this->ball_color == 0)
-            {
-                this->ball_exist = false;
-                this->setCenter(-100, -100, -100);
-            }
-        }
-    }
-
-    void ballUpdate(float timeDiff)
-    {
-        const float TIME_SCALE = 3.3;
-        D3DXVECTOR3 cord = this->getCenter();
-        double vx = abs(this->getVelocity_X());
-        double vz = abs(this->getVelocity_Z());
-        this->pre_center_x = cord.x;
-        this->pre_center_z = cord.z;
-
-        if (vx > 0.01 || vz > 0.01)
-        {
-            float tX = cord.x + TIME_SCALE * timeDiff * m_velocity_x;
-            float tZ = cord.z + TIME_SCALE * timeDiff * m_velocity_z;
-             this->setCenter(tX, cord.y, tZ);
-        }
-        else { this->setPower(0, 0); }
-    }
-
-    double getVelocity_X() { return this->m_velocity_x; }
-    double getVelocity_Z() { return this->m_velocity_z; }
-
-    void setPower(double vx, double vz)
-    {
-        this->m_velocity_x = vx;
-        this->m_velocity_z = vz;
-    }
-
     void setCenter(float x, float y, float z)
     {
         D3DXMATRIX m;
@@ -176,9 +150,10 @@ public:
         setLocalTransform(m);
     }
 
-    bool ball_existance() { return this->ball_exist; }
-    float getRadius(void)  const { return (float)(M_RADIUS); }
+    float getRadius(void)  const { return g_tuning.radius; }
     const D3DXMATRIX& getLocalTransform(void) const { return m_mLocal; }
+    const D3DMATERIAL9& getMaterial(void) const { return m_mtrl; }
+    static ID3DXMesh* getSharedMesh(void) { return s_pSharedMesh; }
     void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
     D3DXVECTOR3 getCenter(void) const
     {
@@ -186,41 +161,49 @@ public:
         return org;
     }
 
-    void setColor(const D3DXCOLOR ball_color)
+private:
+    // every ball has the same radius, so they all share one sphere mesh.
+    // when the radius changes a new one is built; balls still holding the
+    // old mesh let go of it in reloadMesh(). the same goes for the detail.
+    bool acquireMesh(IDirect3DDevice9* pDevice)
     {
-        if (ball_color == d3d::YELLOW)
-            this->ball_color = 0;
-        else if (ball_color == d3d::RED)
-            this->ball_color = 1;
-        else
-            this->ball_color = 2;
-    }
-    void adjustPosition(CSphere& ball) {
-        D3DXVECTOR3 ball_cord = ball.getCenter();
+        if (s_pSharedMesh != NULL && (s_sharedRadius != getRadius() || s_sharedSlices != s_slices))
+            s_pSharedMesh = NULL;
 
-        this->setCenter((center_x + this->pre_center_x) / 2, center_y, (center_z + this->pre_center_z) / 2);
-        ball.setCenter((ball_cord.x + ball.pre_center_x) / 2, ball_cord.y, (ball_cord.z + ball.pre_center_z) / 2);
-        if (this->hasIntersected(ball))
+        if (NULL == s_pSharedMesh)
         {
-            this->setCenter(this->pre_center_x, center_y, this->pre_center_z);
-            ball.setCenter(ball.pre_center_x, ball_cord.y, ball.pre_center_z);
+            if (FAILED(D3DXCreateSphere(pDevice, getRadius(), s_slices, s_slices, &s_pSharedMesh, NULL)))
+                return false;
+            d3d::OptimizeMesh(s_pSharedMesh, "sphere");
+            s_sharedRadius = getRadius();
+            s_sharedSlices = s_slices;
         }
-    }
-    double getPreCenter_x() const {
-        return this->pre_center_x;
+        else
+            s_pSharedMesh->AddRef();
+        m_pSphereMesh = s_pSharedMesh;
+        return true;
     }
 
-    double getPreCenter_z() const {
-        return this->pre_center_z;
+    static void releaseMesh(ID3DXMesh* mesh)
+    {
+        if (0 == mesh->Release() && mesh == s_pSharedMesh)
+            s_pSharedMesh = NULL;
     }
 
-private:
     D3DXMATRIX              m_mLocal;
     D3DMATERIAL9            m_mtrl;
     ID3DXMesh* m_pSphereMesh;
 
+    static ID3DXMesh* s_pSharedMesh;
+    static float s_sharedRadius;
+    static int s_sharedSlices;
+    static int s_slices;
 };
 
+ID3DXMesh* CSphere::s_pSharedMesh = NULL;
+float CSphere::s_sharedRadius = 0;
+int CSphere::s_sharedSlices = 0;
+int CSphere::s_slices = 50;
 
 
 // -----------------------------------------------------------------------------
@@ -237,7 +220,6 @@ private:
     float                   m_width; //  ̴°   
     float                   m_depth; //  ̴°   
     float               m_height;
-    int wall_position;
 
 public:
     CWall(void)
@@ -263,9 +245,11 @@ public:
 
         m_width = iwidth;
         m_depth = idepth;
+        m_height = iheight;
 
         if (FAILED(D3DXCreateBox(pDevice, iwidth, iheight, idepth, &m_pBoundMesh, NULL)))
             return false;
+        d3d::OptimizeMesh(m_pBoundMesh, "box");
         return true;
     }
     void destroy(void)
@@ -284,59 +268,6 @@ public:
         pDevice->SetMaterial(&m_mtrl);
         m_pBoundMesh->DrawSubset(0);
     }
-    // ģ Ȯϰ
-    bool hasIntersected(CSphere& ball)
-    {
-        if (this->wall_position == 0)
-        {
-            if (ball.getCenter().z + ball.getRadius() > this->m_z - (this->m_depth / 2))
-            {
-                return true;
-            }
-        }
-        else if (this->wall_position == 2)
-        {
-            if (ball.getCenter().x + ball.getRadius() > this->m_x - (this->m_width / 2))
-            {
-                return true;
-            }
-        }
-        else if (this->wall_position == 3)
-        {
-            if (ball.getCenter().x - ball.getRadius() < this->m_x + (this->m_width / 2))
-            {
-                return true;
-            }
-        }
-        return false;
-    }
-
-    // 浹  (ӵ  ٲֱ)
-    void hitBy(CSphere& ball)
-    {
-
-        if (this->hasIntersected(ball))
-        {
-            this->adjustPosition(ball);
-            if (this->wall_position == 0) // 
-            {
-                ball.setPower(ball.getVelocity_X(), -ball.getVelocity_Z());
-            }
-            else if (this->wall_position == 1) //Ʒ
-            {
-                return;
-            }
-            else if (this->wall_position == 2) //
-            {
-                ball.setPower(-ball.getVelocity_X(), ball.getVelocity_Z());
-            }
-            else
-            {
-                ball.setPower(-ball.getVelocity_X(), ball.getVelocity_Z());
-            }
-        }
-
-    }
 
     void setPosition(float x, float y, float z)
     {
@@ -349,22 +280,16 @@ public:
         setLocalTransform(m);
     }
 
-    void set_wallPosition(int numbering)
-    {
-        this->wall_position = numbering;
-    }
-
     float getHeight(void) const { return M_HEIGHT; }
-
-    void adjustPosition(CSphere& ball) {
-        ball.setCenter((ball.getCenter().x + ball.getPreCenter_x()) / 2, ball.getCenter().y, (ball.getCenter().z + ball.getPreCenter_z()) / 2);
-        if (this->hasIntersected(ball))
-        {
-            ball.setCenter(ball.getPreCenter_x(), ball.getCenter().y, ball.getPreCenter_z());
-        }
+    void setSize(float width, float height, float depth)
+    {
+        m_width = width;
+        m_height = height;
+        m_depth = depth;
     }
-
-
+    D3DXVECTOR3 getCenter(void) const { return D3DXVECTOR3(m_x, m_y, m_z); }
+    // radius of the sphere around the box
+    float getBoundRadius(void) const { return 0.5f * sqrt(m_width * m_width + m_height * m_height + m_depth * m_depth); }
 
 private:
     void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
@@ -460,231 +385,1538 @@ private:
     d3d::BoundingSphere m_bound;
 };
 
+// -----------------------------------------------------------------------------
+// CParticles class definition
+// draws the debris and sparks of a ParticlePool (particles.h): draw() writes
+// the live particles straight into a dynamic vertex buffer as a point list and
+// draws it in as few calls as the device's MaxPrimitiveCount allows (usually
+// one).
+// -----------------------------------------------------------------------------
+class CParticles {
+public:
+    CParticles(void)
+    {
+        m_size = 3.0f;
+        m_maxPrimitives = 0;
+        m_pVB = NULL;
+    }
+    ~CParticles(void) {}
+public:
+    bool create(IDirect3DDevice9* pDevice)
+    {
+        if (NULL == pDevice)
+            return false;
+
+        D3DCAPS9 caps;
+        if (FAILED(pDevice->GetDeviceCaps(&caps)) || caps.MaxPrimitiveCount == 0)
+            return false;
+        m_maxPrimitives = caps.MaxPrimitiveCount;
+
+        // dynamic, so every frame can discard it and fill it without waiting for the GPU
+        return SUCCEEDED(pDevice->CreateVertexBuffer(ParticlePool::CAPACITY * sizeof(Vertex),
+            D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY | D3DUSAGE_POINTS, D3DFVF_XYZ | D3DFVF_DIFFUSE,
+            D3DPOOL_DEFAULT, &m_pVB, NULL));
+    }
+
+    void destroy(void)
+    {
+        if (m_pVB != NULL) {
+            m_pVB->Release();
+            m_pVB = NULL;
+        }
+    }
+
+    void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld, const ParticlePool& pool)
+    {
+        int count = pool.getCount();
+        if (NULL == pDevice || NULL == m_pVB || count == 0)
+            return;
+
+        void* data;
+        if (FAILED(m_pVB->Lock(0, count * sizeof(Vertex), &data, D3DLOCK_DISCARD)))
+            return;
+        Vertex* vertices = (Vertex*)data;
+        const float* x = pool.getX();
+        const float* y = pool.getY();
+        const float* z = pool.getZ();
+        const unsigned int* color = pool.getColor();
+        for (int i = 0; i < count; i++) {
+            vertices[i].x = x[i];
+            vertices[i].y = y[i];
+            vertices[i].z = z[i];
+            vertices[i].color = color[i];
+        }
+        m_pVB->Unlock();
+
+        DWORD size;
+        memcpy(&size, &m_size, sizeof(size));
+        pDevice->SetTransform(D3DTS_WORLD, &mWorld);
+        pDevice->SetRenderState(D3DRS_LIGHTING, FALSE);
+        pDevice->SetRenderState(D3DRS_POINTSIZE, size);
+        pDevice->SetFVF(D3DFVF_XYZ | D3DFVF_DIFFUSE);
+        pDevice->SetStreamSource(0, m_pVB, 0, sizeof(Vertex));
+        for (int first = 0; first < count; first += (int)m_maxPrimitives) {
+            UINT points = (UINT)(count - first);
+            if (points > m_maxPrimitives)
+                points = m_maxPrimitives;
+            pDevice->DrawPrimitive(D3DPT_POINTLIST, (UINT)first, points);
+        }
+        pDevice->SetStreamSource(0, NULL, 0, 0);
+        pDevice->SetRenderState(D3DRS_LIGHTING, TRUE);
+    }
+
+private:
+    struct Vertex {
+        float x, y, z;
+        D3DCOLOR color;
+    };
+
+    float       m_size;
+    DWORD       m_maxPrimitives;    // points one draw call may take on this device
+    IDirect3DVertexBuffer9* m_pVB;
+};
+
 
 // -----------------------------------------------------------------------------
 // Global variables
 // -----------------------------------------------------------------------------
 CWall   g_legoPlane;
-CWall   g_legowall[3];
-CSphere   g_sphere[6];
-CSphere   g_target_whiteball;
-CSphere red_ball;
+CWall   g_legowall[WALL_COUNT];
 CLight   g_light;
-int ball_num = 6;
-int wall_num = 3;
-bool startflag = false;
-double g_camera_pos[3] = { 0.0, 5.0, -8.0 };
+ParticlePool g_particles;
+CParticles g_particleBuffer;         // draws g_particles
+int wall_num = WALL_COUNT;
+Level g_level;                      // bricks of the game in the window, -level file or default
+CSphere g_sphere[MAX_BRICKS];       // these only draw what is in g_state
+
+// drawWorld() culls the table, the walls, every brick and the three balls in one batch
+static_assert(1 + WALL_COUNT + MAX_BRICKS + 3 <= d3d::SphereBatch::CAPACITY, "a SphereBatch holds every object");
+CSphere g_target_whiteball;
+CSphere red_ball;
+CSphere g_rival_whiteball;          // paddle of the second player, versus only
 
 // -----------------------------------------------------------------------------
-// Functions
+// Simulation state (simulation.h)
+// the game in the window. the CSphere objects above only draw it. the
+// table, light and camera stand where softRender.h says.
 // -----------------------------------------------------------------------------
+SimState g_state;
+Residency g_residency;          // strips drawn this frame (simulation.h)
 
+// -----------------------------------------------------------------------------
+// Snapshots
+// SimState is one flat block of plain values, so a snapshot or restore is a
+// single memcpy. the ring keeps the state before each of the last SNAPSHOT_COUNT
+// ticks for rolling back. nothing that only changes how the game is drawn touches it;
+// only a new level, whose bricks the alive bits would no longer match, empties
+// the ring.
+// -----------------------------------------------------------------------------
+#define SNAPSHOT_COUNT 128
 
-void destroyAllLegoBlock(void)
+static_assert(std::is_trivially_copyable<SimState>::value, "SimState must stay a flat block");
+
+struct SnapshotRing {
+    SimState states[SNAPSHOT_COUNT];
+    int next;       // slot the next snapshot goes to
+    int count;      // valid snapshots, at most SNAPSHOT_COUNT
+};
+SnapshotRing g_snapshots;
+
+void saveSnapshot(SimState& to, const SimState& from)
 {
+    memcpy(&to, &from, sizeof(SimState));
 }
 
-// initialization
-bool Setup()
+void pushSnapshot(SnapshotRing& ring, const SimState& state)
 {
-    int i;
-
-    D3DXMatrixIdentity(&g_mWorld);
-    D3DXMatrixIdentity(&g_mView);
-    D3DXMatrixIdentity(&g_mProj);
-
-    // create plane and set the position
-    if (false == g_legoPlane.create(Device, -1, -1, 6.6f, 0.03f, 9, d3d::GREEN)) return false;
-    g_legoPlane.setPosition(0.0f, -0.0006f / 5, 0.0f);
+    saveSnapshot(ring.states[ring.next], state);
+    ring.next = (ring.next + 1) % SNAPSHOT_COUNT;
+    if (ring.count < SNAPSHOT_COUNT)
+        ring.count++;
+}
 
-    // create walls and set the position. note that there are four walls
-    if (false == g_legowall[0].create(Device, -1, -1, 6.6f, 0.3f, 0.12f, d3d::DARKRED)) return false; //     &    
-    {
-        g_legowall[0].setPosition(0.0f, 0.12f, 4.5f);
-        g_legowall[0].set_wallPosition(0);
-    }
-    if (false == g_legowall[1].create(Device, -1, -1, 0.12f, 0.3f, 9, d3d::DARKRED)) return false; //    
-    {
-        g_legowall[1].setPosition(3.24f, 0.12f, 0.0f);
-        g_legowall[1].set_wallPosition(2);
-    }
-    if (false == g_legowall[2].create(Device, -1, -1, 0.12f, 0.3f, 9, d3d::DARKRED)) return false; //    
-    {
-        g_legowall[2].setPosition(-3.24f, 0.12f, 0.0f);
-        g_legowall[2].set_wallPosition(3);
-    }
+// restores the state from frames pushes ago (1 is the newest) and drops the
+// newer ones. returns false when the ring does not reach back that far.
+bool rollback(SnapshotRing& ring, int frames, SimState& state)
+{
+    if (frames < 1 || frames > ring.count)
+        return false;
+    ring.next = (ring.next - frames + SNAPSHOT_COUNT) % SNAPSHOT_COUNT;
+    ring.count -= frames;
+    saveSnapshot(state, ring.states[ring.next]);
+    return true;
+}
 
-    // create four balls and set the position
-    for (i = 0; i < ball_num; i++) {
-        if (false == g_sphere[i].create(Device, sphereColor[i])) return false;
-        g_sphere[i].setCenter(spherePos[i][0], (float)M_RADIUS, spherePos[i][1]);
-        g_sphere[i].setPower(0, 0);
-        g_sphere[i].setColor(sphereColor[i]);
-    }
+void clearSnapshots(SnapshotRing& ring)
+{
+    ring.next = 0;
+    ring.count = 0;
+}
+double g_camera_pos[3] = { 0.0, 5.0, -8.0 };
 
-    // create white mouse ball for set direction
-    if (false == g_target_whiteball.create(Device, d3d::WHITE)) return false;
-    g_target_whiteball.setCenter(0.0f, 0.12f, -4.5f);
-    g_target_whiteball.setColor(d3d::WHITE);
+EventBuffer g_gameEvents;               // events of the game in the window (events.h)
 
-    //create red ball for set direction
-    if (false == red_ball.create(Device, d3d::RED)) return false;
-    red_ball.setCenter(0.0f, 0.12f, -4.5f + red_ball.getRadius() * 2);
-    red_ball.setColor(d3d::RED);
+// -----------------------------------------------------------------------------
+// Input frames
+// WndProc only records what the player asked for. Display() cuts the frame
+// time into SIM_STEP ticks and applies the input before each of them (a launch
+// only before the first), so the game depends on nothing but the FrameInput of
+// every tick, not on how long the frames took. a frame too short for a tick
+// keeps the input for the next one.
+// -----------------------------------------------------------------------------
+#define MAX_FRAME_TICKS 4           // ticks one frame runs at most, a longer frame loses the rest
 
-    // light setting 
-    D3DLIGHT9 lit;
-    ::ZeroMemory(&lit, sizeof(lit));
-    lit.Type = D3DLIGHT_POINT;
-    lit.Diffuse = d3d::WHITE;
-    lit.Specular = d3d::WHITE * 0.9f;
-    lit.Ambient = d3d::WHITE * 0.9f;
-    lit.Position = D3DXVECTOR3(0.0f, 4.0f, 0.0f);
-    lit.Range = 100.0f;
-    lit.Attenuation0 = 0.0f;
-    lit.Attenuation1 = 0.9f;
-    lit.Attenuation2 = 0.0f;
-    if (false == g_light.create(Device, lit))
-        return false;
+FrameInput g_input = { 0.0f, false };
+double g_simTime = 0;               // frame time no tick has run for yet, in timeDelta units
 
-    // Position and aim the camera.
-    D3DXVECTOR3 pos(0.0f, 8.0f, -8.0f);
-    D3DXVECTOR3 target(0.0f, 0.0f, 0.0f);
-    D3DXVECTOR3 up(0.0f, 2.0f, 0.0f);
-    D3DXMatrixLookAtLH(&g_mView, &pos, &target, &up);
-    Device->SetTransform(D3DTS_VIEW, &g_mView);
+// -----------------------------------------------------------------------------
+// Versus (netplay.h)
+// -host <port> or -join <name:port> play the game in the window against another
+// machine. the host moves the white paddle, the guest the blue one, and both
+// run the ticks in lockstep. a frame never waits for the other side: a tick
+// whose inputs are not there yet runs in a later frame.
+// -----------------------------------------------------------------------------
+NetPeer* g_net = NULL;
+bool g_netLatencyOk = true;         // last netLatencyOk(), a change is reported
+unsigned int g_netScore = 0;        // score in the window title, player 1 in the high half
 
-    // Set the projection matrix.
-    D3DXMatrixPerspectiveFovLH(&g_mProj, D3DX_PI / 4,
-        (float)Width / (float)Height, 1.0f, 100.0f);
-    Device->SetTransform(D3DTS_PROJECTION, &g_mProj);
+// -----------------------------------------------------------------------------
+// Telemetry
+// one TelemetrySample per frame is published into a named shared-memory ring
+// (layout in telemetry.h) so monitors can read it without touching the game.
+// the name carries the process id: telemetryTail <pid> finds it.
+// -----------------------------------------------------------------------------
+HANDLE g_telemetryMap = NULL;
+TelemetryRing* g_telemetry = NULL;
+TelemetrySample g_stats;            // sample of the frame being built
 
-    // Set render states.
-    Device->SetRenderState(D3DRS_LIGHTING, TRUE);
-    Device->SetRenderState(D3DRS_SPECULARENABLE, TRUE);
-    Device->SetRenderState(D3DRS_SHADEMODE, D3DSHADE_GOURAUD);
+void openTelemetry(void)
+{
+    char name[TELEMETRY_NAME_MAX];
+    sprintf(name, TELEMETRY_NAME, (unsigned long)::GetCurrentProcessId());
+    g_telemetryMap = ::CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(TelemetryRing), name);
+    if (NULL == g_telemetryMap)
+        return;
+
+    // a monitor still holds the ring of an earlier game that had our pid. its
+    // layout may be older, so the game goes without telemetry.
+    if (::GetLastError() == ERROR_ALREADY_EXISTS) {
+        ::OutputDebugString("telemetry: the segment already exists, not publishing\n");
+        ::CloseHandle(g_telemetryMap);
+        g_telemetryMap = NULL;
+        return;
+    }
 
-    g_light.setLight(Device, g_mWorld);
-    return true;
+    g_telemetry = (TelemetryRing*)::MapViewOfFile(g_telemetryMap, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(TelemetryRing));
+    if (NULL == g_telemetry) {
+        ::CloseHandle(g_telemetryMap);
+        g_telemetryMap = NULL;
+        return;
+    }
+    g_telemetry->magic = TELEMETRY_MAGIC;
+    g_telemetry->version = TELEMETRY_VERSION;
+    g_telemetry->capacity = TELEMETRY_CAPACITY;
+    g_telemetry->written = 0;
 }
 
-void Cleanup(void)
+void closeTelemetry(void)
 {
-    g_legoPlane.destroy();
-    for (int i = 0; i < wall_num; i++) {
-        g_legowall[i].destroy();
+    if (g_telemetry != NULL) {
+        ::UnmapViewOfFile(g_telemetry);
+        g_telemetry = NULL;
+    }
+    if (g_telemetryMap != NULL) {
+        ::CloseHandle(g_telemetryMap);
+        g_telemetryMap = NULL;
     }
-    destroyAllLegoBlock();
-    g_light.destroy();
 }
 
-
-// timeDelta represents the time between the current image frame and the last image frame.
-// the distance of moving balls should be "velocity * timeDelta"
-bool Display(float timeDelta)
+// single writer: fill the slot, then publish it by bumping the counter
+void publishTelemetry(const TelemetrySample& sample)
 {
-    int i = 0;
-    int j = 0;
+    if (NULL == g_telemetry)
+        return;
 
+    long n = g_telemetry->written;
+    g_telemetry->samples[n & (TELEMETRY_CAPACITY - 1)] = sample;
+    ::InterlockedExchange(&g_telemetry->written, n + 1);
+}
 
-    if (Device)
-    {
-        if (startflag)
-        {
-            Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x00afafaf, 1.0f, 0);
-            Device->BeginScene();
-
-            // check whether any two balls hit together and update the direction of balls
-            for (i = 0; i < ball_num; i++) {
-                g_sphere[i].hitBy(red_ball);
-            }
+// -----------------------------------------------------------------------------
+// Input latency
+// WndProc only adds mouse movement up; the frame applies it once. the time the
+// first input of a frame was queued is kept until that frame has been presented,
+// which gives the input-to-present latency.
+// -----------------------------------------------------------------------------
+#define LATENCY_SAMPLES 1024
 
-            // update the position of each ball. during update, check whether each ball hit by walls.
-            for (i = 0; i < ball_num; i++) {
-                g_sphere[i].ballUpdate(timeDelta);
-            }
+float g_dragX = 0, g_dragY = 0;     // left-drag pixels not applied to g_mWorld yet
+double g_inputTime = 0;             // arrival of the oldest input not on screen yet, 0 = none
+float g_latency[LATENCY_SAMPLES];   // last input-to-present times in ms
+long g_latencyCount = 0;
 
-            for (i = 0; i < wall_num; i++) {
-                g_legowall[i].hitBy(red_ball);
-            }
+// stamps the input with the time its message was queued, not the time WndProc
+// got to it. message times are GetTickCount() milliseconds, so the age of the
+// message is taken off the QPC clock.
+void noteInput(void)
+{
+    if (g_inputTime != 0)
+        return;
+    DWORD age = ::GetTickCount() - (DWORD)::GetMessageTime();
+    g_inputTime = d3d::SystemClock() - age / 1000.0;
+}
 
-            g_target_whiteball.hitBy(red_ball);
-            g_target_whiteball.ballUpdate(timeDelta);
-
-            if (red_ball.getCenter().z < -5.0f)
-            {
-                CSphere temp;
-                temp.create(Device, d3d::RED);
-                temp.setCenter(g_target_whiteball.getCenter().x, g_target_whiteball.getCenter().y, g_target_whiteball.getCenter().z + red_ball.getRadius() * 2);
-                red_ball.destroy();
-                red_ball = temp;
-                startflag = false;
-            }
+// rotate the view by the drag collected since the last frame
+void applyDrag(void)
+{
+    if (g_dragX == 0 && g_dragY == 0)
+        return;
+
+    D3DXMATRIX mX;
+    D3DXMATRIX mY;
+    D3DXMatrixRotationY(&mX, g_dragX * 0.01f);
+    D3DXMatrixRotationX(&mY, g_dragY * 0.01f);
+    g_mWorld = g_mWorld * mX * mY;
+    g_dragX = 0;
+    g_dragY = 0;
+}
 
-            red_ball.ballUpdate(timeDelta);
+float recordLatency(double inputTime)
+{
+    float ms = (float)((d3d::SystemClock() - inputTime) * 1000.0);
+    g_latency[g_latencyCount++ % LATENCY_SAMPLES] = ms;
+    return ms;
+}
 
-            // draw plane, walls, and spheres
-            g_legoPlane.draw(Device, g_mWorld);
-            for (i = 0; i < wall_num; i++) {
-                g_legowall[i].draw(Device, g_mWorld);
-            }
-            for (i = 0; i < ball_num; i++) {
-                if (g_sphere[i].ball_existance() == false)
-                    continue;
-                g_sphere[i].draw(Device, g_mWorld);
-            }
-            g_target_whiteball.draw(Device, g_mWorld);
-            red_ball.draw(Device, g_mWorld);
-            g_light.draw(Device);
+// writes the 50th/95th/99th percentile of the recent latencies to the debugger output
+void reportLatency(void)
+{
+    int n = g_latencyCount < LATENCY_SAMPLES ? (int)g_latencyCount : LATENCY_SAMPLES;
+    if (n == 0)
+        return;
+
+    float sorted[LATENCY_SAMPLES];
+    memcpy(sorted, g_latency, n * sizeof(float));
+    std::sort(sorted, sorted + n);
+
+    char line[128];
+    snprintf(line, sizeof(line), "input to present: p50 %.2fms p95 %.2fms p99 %.2fms (%d inputs)\n",
+        sorted[n * 50 / 100], sorted[n * 95 / 100], sorted[n * 99 / 100], n);
+    ::OutputDebugString(line);
+}
 
-            Device->EndScene();
-            Device->Present(0, 0, 0, 0);
-            Device->SetTexture(0, NULL);
+// -----------------------------------------------------------------------------
+// Functions
+// -----------------------------------------------------------------------------
 
-            return true;
-        }
-        else //  ų space  ȴ 
-        {
-            Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x00afafaf, 1.0f, 0);
-            Device->BeginScene();
 
+void destroyAllLegoBlock(void)
+{
+    for (int i = 0; i < g_level.count; i++) {
+        g_sphere[i].destroy();
+    }
+}
 
-            red_ball.setCenter(g_target_whiteball.getCenter().x, g_target_whiteball.getCenter().y, g_target_whiteball.getCenter().z + red_ball.getRadius()*2);
-            red_ball.ballUpdate(timeDelta);
+// copies the next word of the command line to word and returns where the one
+// after it starts. words are split the way the C runtime splits argv: spaces
+// and tabs separate them, and double quotes keep spaces inside one word.
+const char* nextWord(const char* p, char* word, size_t size)
+{
+    size_t n = 0;
+    bool quoted = false;
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+    while (*p != '\0' && (quoted || (*p != ' ' && *p != '\t'))) {
+        if (*p == '"')
+            quoted = !quoted;
+        else if (n + 1 < size)
+            word[n++] = *p;
+        p++;
+    }
+    word[n] = '\0';
+    return p;
+}
 
-            // draw plane, walls, and spheres
-            g_legoPlane.draw(Device, g_mWorld);
-            for (i = 0; i < wall_num; i++) {
-                g_legowall[i].draw(Device, g_mWorld);
-            }
-            for (i = 0; i < ball_num; i++) {
-                if (g_sphere[i].ball_existance() == false)
-                    continue;
-                g_sphere[i].draw(Device, g_mWorld);
-            }
-             
-            g_target_whiteball.draw(Device, g_mWorld);
-            red_ball.draw(Device, g_mWorld);
-            g_light.draw(Device);
+// returns true if the word "-name" is on the command line. the word that
+// follows it is copied to value; quote it if it has spaces (-level "my levels\a.txt").
+bool getOption(const char* cmdLine, const char* name, char* value = NULL, size_t size = 0)
+{
+    char word[MAX_PATH];
+    const char* p = cmdLine;
 
-            Device->EndScene();
-            Device->Present(0, 0, 0, 0);
-            Device->SetTexture(0, NULL);
+    for (;;) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '\0')
+            return false;
+        p = nextWord(p, word, sizeof(word));
+        if (strcmp(word, name) != 0)
+            continue;
 
-            return true;
-        }
+        if (value != NULL && size > 0)
+            nextWord(p, value, size);
+        return true;
     }
+}
+
+// -----------------------------------------------------------------------------
+// Hot reload
+// the -tuning and -level files are checked twice a second between frames.
+// a changed file is applied in place: only the meshes or bricks it affects are
+// rebuilt, and the game keeps running.
+//
+// tuning file, one "name value" per line:    radius 0.21
+//                                            time_scale 3.3
+//                                            launch_speed 2
+//                                            friction 0    (1 slows the ball down,
+//                                                           it may stop on the table)
+// level file, one brick "x z" per line (up to MAX_BRICKS). '#' starts a comment.
+// a file with more bricks is cut off at MAX_BRICKS, which the debugger output
+// reports.
+// -----------------------------------------------------------------------------
+struct WatchedFile {
+    char name[MAX_PATH];
+    FILETIME written;
+};
 
+WatchedFile g_tuningFile = { "", { 0, 0 } };
+WatchedFile g_levelFile = { "", { 0, 0 } };
+
+// true if the file was written since the last call
+bool fileChanged(WatchedFile& file)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (file.name[0] == '\0' || !::GetFileAttributesEx(file.name, GetFileExInfoStandard, &data))
+        return false;
+    if (::CompareFileTime(&data.ftLastWriteTime, &file.written) == 0)
+        return false;
+    file.written = data.ftLastWriteTime;
+    return true;
 }
 
-// 콺  Ƹ
-LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+bool readTuning(const char* fileName, Tuning& tuning)
 {
-    static bool wire = false;
+    FILE* file = fopen(fileName, "r");
+    if (NULL == file)
+        return false;
+
+    char line[256], name[64];
+    float value;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%63s %f", name, &value) != 2)
+            continue;
+        // values the simulation can't run with are skipped, the old one stays
+        if (strcmp(name, "radius") == 0 && value > 0)
+            tuning.radius = value;
+        else if (strcmp(name, "time_scale") == 0 && value > 0)
+            tuning.time_scale = value;
+        else if (strcmp(name, "launch_speed") == 0 && value >= 0)
+            tuning.launch_speed = value;
+        else if (strcmp(name, "friction") == 0 && (value == 0 || value == 1))
+            tuning.friction = value;
+    }
+    fclose(file);
+    return true;
+}
+
+// every ball moves over to the current shared sphere mesh
+void reloadBallMeshes(void)
+{
+    for (int i = 0; i < g_level.count; i++) {
+        g_sphere[i].reloadMesh(Device);
+    }
+    g_target_whiteball.reloadMesh(Device);
+    red_ball.reloadMesh(Device);
+    g_rival_whiteball.reloadMesh(Device);
+}
+
+void applyTuning(const Tuning& tuning)
+{
+    bool resized = tuning.radius != g_tuning.radius;
+    g_tuning = tuning;
+    if (!resized)
+        return;
+
+    // new radius: one new shared mesh
+    reloadBallMeshes();
+}
+
+void applyLevel(float pos[MAX_BRICKS][2], int count)
+{
+    int i;
+
+    clearSnapshots(g_snapshots);
+    for (i = 0; i < count; i++) {
+        bool added = i >= g_level.count;
+        bool moved = added || pos[i][0] != g_level.pos[i][0] || pos[i][1] != g_level.pos[i][1];
+        if (added)
+            g_sphere[i].create(Device, d3d::YELLOW);
+        if (moved) {
+            // a brick that moved comes back to life where it now is
+            g_level.pos[i][0] = pos[i][0];
+            g_level.pos[i][1] = pos[i][1];
+            setBrickAlive(g_state, i, true);
+        }
+    }
+    for (i = count; i < g_level.count; i++) {
+        g_sphere[i].destroy();
+        setBrickAlive(g_state, i, false);
+    }
+
+    g_level.count = count;
+    buildChunks(g_level);
+}
+
+// readLevel() that reports a level cut off at MAX_BRICKS
+int loadLevel(const char* fileName, float pos[MAX_BRICKS][2])
+{
+    int listed = 0;
+    int count = readLevel(fileName, pos, &listed);
+    if (count >= 0 && listed > count) {
+        char message[MAX_PATH + 64];
+        sprintf(message, "%s: %d bricks, only the first %d are used\n", fileName, listed, count);
+        ::OutputDebugString(message);
+    }
+    return count;
+}
+
+void reopenGrid(void);     // Game grid, below
+
+void checkReload(void)
+{
+    static double nextCheck = 0;
+    double now = d3d::SystemClock();
+    if (now < nextCheck)
+        return;
+    nextCheck = now + 0.5;
+
+    if (fileChanged(g_tuningFile)) {
+        Tuning tuning = g_tuning;
+        if (readTuning(g_tuningFile.name, tuning))
+            applyTuning(tuning);
+    }
+    if (fileChanged(g_levelFile)) {
+        float pos[MAX_BRICKS][2];
+        int count = loadLevel(g_levelFile.name, pos);
+        if (count >= 0) {
+            applyLevel(pos, count);
+            reopenGrid();
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Quality governor
+// the time a frame takes to simulate and draw (not the time spent waiting for
+// the next one) picks a level from QUALITY. slow machines get rougher spheres
+// and fewer particles, fast ones get them back.
+// -----------------------------------------------------------------------------
+struct QualityLevel {
+    int sphereSlices;   // slices and stacks of the ball mesh
+    int particles;      // live particle limit
+};
+const QualityLevel QUALITY[] = {
+    { 12, 16384 },
+    { 20, 65536 },
+    { 32, 200000 },
+    { 50, ParticlePool::CAPACITY },
+};
+const int QUALITY_LEVELS = sizeof(QUALITY) / sizeof(QUALITY[0]);
+
+d3d::QualityGovernor g_governor(QUALITY_LEVELS);
+int g_quality = QUALITY_LEVELS - 1;     // level in use
+bool g_qualityFixed = false;            // -quality <n> turns the governor off
+
+void applyQuality(int level)
+{
+    if (level == g_quality)
+        return;
+    g_quality = level;
+    CSphere::setDetail(QUALITY[level].sphereSlices);
+    reloadBallMeshes();
+    g_particles.setLimit(QUALITY[level].particles);
+}
+
+void governQuality(double frameMs)
+{
+    if (g_qualityFixed)
+        return;
+    applyQuality(g_governor.update(frameMs));
+}
+
+// -frametrace <file>: runs the governor over frame times read from the file
+// (milliseconds, one per line) and writes "time level average" lines to
+// <file>.out, so its behaviour can be checked without a window or a GPU.
+bool runFrameTrace(const char* fileName)
+{
+    char outName[MAX_PATH];
+    snprintf(outName, sizeof(outName), "%s.out", fileName);
+
+    FILE* in = fopen(fileName, "r");
+    if (in == NULL)
+        return false;
+    FILE* out = fopen(outName, "w");
+    if (out == NULL) {
+        fclose(in);
+        return false;
+    }
+
+    d3d::QualityGovernor governor(QUALITY_LEVELS);
+    double ms;
+    while (fscanf(in, "%lf", &ms) == 1) {
+        int level = governor.update(ms);
+        fprintf(out, "%.3f %d %.3f\n", ms, level, governor.average());
+    }
+    fclose(in);
+    fclose(out);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Table layout
+// -----------------------------------------------------------------------------
+// size and place the walls. only the geometry, Setup() builds their meshes.
+void layoutWalls(void)
+{
+    for (int i = 0; i < wall_num; i++) {
+        const WallLayout& wall = WALL_LAYOUT[i];
+        g_legowall[i].setSize(wall.width, wall.height, wall.depth);
+        g_legowall[i].setPosition(wall.x, wall.y, wall.z);
+    }
+}
+
+// copy where the balls of g_state are to the objects that draw them, for the
+// bricks of the resident strips
+void placeBalls(void)
+{
+    for (int k = 0; k < g_residency.count; k++) {
+        int i = g_residency.bricks[k];
+        g_sphere[i].setCenter(g_level.pos[i][0], g_tuning.radius, g_level.pos[i][1]);
+    }
+    g_target_whiteball.setCenter(g_state.paddle.x, BALL_Y, g_state.paddle.z);
+    red_ball.setCenter(g_state.ball.x, BALL_Y, g_state.ball.z);
+    g_rival_whiteball.setCenter(g_state.rival.x, BALL_Y, g_state.rival.z);
+}
+
+// initialization
+bool Setup()
+{
+    d3d::TraceScope trace("Setup");
+    int i;
+
+    D3DXMatrixIdentity(&g_mWorld);
+    D3DXMatrixIdentity(&g_mView);
+    D3DXMatrixIdentity(&g_mProj);
+
+    // create plane and set the position
+    if (false == g_legoPlane.create(Device, -1, -1, TABLE_WIDTH, TABLE_HEIGHT, TABLE_DEPTH, d3d::GREEN)) return false;
+    g_legoPlane.setPosition(0.0f, TABLE_Y, 0.0f);
+
+    // create walls and set the position. note that there are four walls
+    layoutWalls();
+    for (i = 0; i < wall_num; i++) {
+        const WallLayout& wall = WALL_LAYOUT[i];
+        if (false == g_legowall[i].create(Device, -1, -1, wall.width, wall.height, wall.depth, d3d::DARKRED)) return false;
+    }
+
+    // create the bricks and the balls, then put everything where a game starts
+    for (i = 0; i < g_level.count; i++) {
+        if (false == g_sphere[i].create(Device, d3d::YELLOW)) return false;
+    }
+    if (false == g_target_whiteball.create(Device, d3d::WHITE)) return false;
+    if (false == red_ball.create(Device, d3d::RED)) return false;
+    if (false == g_rival_whiteball.create(Device, d3d::BLUE)) return false;
+    resetState(g_level, g_state);
+    buildChunks(g_level);
+    clearResidency(g_residency);
+
+    // light setting 
+    D3DLIGHT9 lit;
+    ::ZeroMemory(&lit, sizeof(lit));
+    lit.Type = D3DLIGHT_POINT;
+    lit.Diffuse = d3d::WHITE;
+    lit.Specular = d3d::WHITE * 0.9f;
+    lit.Ambient = d3d::WHITE * 0.9f;
+    lit.Position = D3DXVECTOR3(0.0f, LIGHT_Y, 0.0f);
+    lit.Range = 100.0f;
+    lit.Attenuation0 = 0.0f;
+    lit.Attenuation1 = 0.9f;
+    lit.Attenuation2 = 0.0f;
+    if (false == g_light.create(Device, lit))
+        return false;
+    if (false == g_particleBuffer.create(Device))
+        return false;
+
+    // Position and aim the camera.
+    D3DXVECTOR3 pos(0.0f, CAMERA_Y, CAMERA_Z);
+    D3DXVECTOR3 target(0.0f, 0.0f, 0.0f);
+    D3DXVECTOR3 up(0.0f, 2.0f, 0.0f);
+    D3DXMatrixLookAtLH(&g_mView, &pos, &target, &up);
+    Device->SetTransform(D3DTS_VIEW, &g_mView);
+
+    // Set the projection matrix.
+    D3DXMatrixPerspectiveFovLH(&g_mProj, D3DX_PI / 4,
+        (float)Width / (float)Height, 1.0f, 100.0f);
+    Device->SetTransform(D3DTS_PROJECTION, &g_mProj);
+
+    // Set render states.
+    Device->SetRenderState(D3DRS_LIGHTING, TRUE);
+    Device->SetRenderState(D3DRS_SPECULARENABLE, TRUE);
+    Device->SetRenderState(D3DRS_SHADEMODE, D3DSHADE_GOURAUD);
+
+    g_light.setLight(Device, g_mWorld);
+    return true;
+}
+
+void Cleanup(void)
+{
+    g_legoPlane.destroy();
+    for (int i = 0; i < wall_num; i++) {
+        g_legowall[i].destroy();
+    }
+    destroyAllLegoBlock();
+    g_target_whiteball.destroy();
+    red_ball.destroy();
+    g_rival_whiteball.destroy();
+    g_light.destroy();
+    g_particleBuffer.destroy();
+    closeTelemetry();
+}
+
+
+// -----------------------------------------------------------------------------
+// Shot solver (hint mode)
+// tries many paddle positions for the launch, plays every shot out on its own
+// copy of the state and keeps the one that destroys the most bricks without
+// losing the ball. the candidates are dealt out to one worker per core; every
+// worker keeps its own best result and stops when the time budget runs out.
+// they are tried coarse to fine, in bit-reversed order (0, 1/2, 1/4, 3/4, ...
+// of the paddle range), so a budget that runs out early still has covered the
+// whole table, only more sparsely.
+// -----------------------------------------------------------------------------
+#define SOLVER_STEP SIM_STEP        // one tick of the game
+#define SOLVER_STEPS 300            // five seconds of play per shot
+#define SOLVER_MIN_X PADDLE_MIN_X
+#define SOLVER_MAX_X PADDLE_MAX_X
+
+struct ShotResult {
+    int candidate;
+    int score;
+};
+
+// score of launching from paddle_x: 10 per brick destroyed, -5 if the ball is lost
+int playShot(const SimState& start, float paddle_x)
+{
+    SimState state = start;
+    int bricks_before = countBricks(state);
+
+    state.paddle.x = paddle_x;
+    placeBall(state.ball, paddle_x, state.paddle.z + g_tuning.radius * 2);
+    state.ball.vz = g_tuning.launch_speed;
+    state.started = true;
+
+    for (int i = 0; i < SOLVER_STEPS && state.started; i++)
+        simulate(g_level, state, SOLVER_STEP);
+
+    int bricks_after = countBricks(state);
+    return (bricks_before - bricks_after) * 10 - (state.started ? 0 : 5);
+}
+
+float candidateX(int candidate, int candidates)
+{
+    if (candidates < 2)
+        return 0.0f;
+    return SOLVER_MIN_X + (SOLVER_MAX_X - SOLVER_MIN_X) * candidate / (candidates - 1);
+}
+
+// the lowest bits of index, mirrored
+unsigned int reverseBits(unsigned int index, int bits)
+{
+    unsigned int reversed = 0;
+    for (int b = 0; b < bits; b++) {
+        reversed = (reversed << 1) | (index & 1);
+        index >>= 1;
+    }
+    return reversed;
+}
+
+void solveShots(const SimState* start, int first, int step, int candidates, double deadline, ShotResult* best)
+{
+    d3d::TraceScope trace("solver task");
+
+    int bits = 0;
+    while ((1 << bits) < candidates)
+        bits++;
+
+    best->candidate = -1;
+    best->score = INT_MIN;
+    for (int i = first; i < (1 << bits); i += step) {
+        int c = (int)reverseBits((unsigned int)i, bits);
+        if (c >= candidates)
+            continue;
+        if (d3d::SystemClock() > deadline)
+            break;
+        int score = playShot(*start, candidateX(c, candidates));
+        if (score > best->score || (score == best->score && c < best->candidate)) {
+            best->candidate = c;
+            best->score = score;
+        }
+    }
+}
+
+// returns the best paddle x for the next launch, trying up to candidates positions within budgetMs
+float findBestShot(const SimState& start, int candidates, double budgetMs)
+{
+    d3d::TraceScope trace("findBestShot");
+    double deadline = d3d::SystemClock() + budgetMs / 1000.0;
+
+    int workers = (int)std::thread::hardware_concurrency();
+    if (workers < 1)
+        workers = 1;
+
+    std::vector<ShotResult> results(workers);
+    std::vector<std::thread> threads;
+    for (int t = 1; t < workers; t++)
+        threads.push_back(std::thread(solveShots, &start, t, workers, candidates, deadline, &results[t]));
+    solveShots(&start, 0, workers, candidates, deadline, &results[0]);
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    // ties go to the lower candidate so the answer does not depend on thread timing
+    ShotResult best = results[0];
+    for (int t = 1; t < workers; t++) {
+        if (results[t].candidate < 0)
+            continue;
+        if (best.candidate < 0 || results[t].score > best.score ||
+            (results[t].score == best.score && results[t].candidate < best.candidate))
+            best = results[t];
+    }
+    if (best.candidate < 0)
+        return start.paddle.x;
+    return candidateX(best.candidate, candidates);
+}
+
+// -----------------------------------------------------------------------------
+// Spectator stream
+// -broadcast <file> writes one small record per frame: what moved since the
+// previous frame, as quantized deltas in varints, plus a full keyframe every
+// STREAM_KEYFRAME_INTERVAL frames. -spectate <file> plays such a file back
+// through the normal renderer instead of simulating.
+// the stream starts with STREAM_MAGIC and the brick count and hashLevel() of
+// the level it was recorded on, as varints. a spectator on another level
+// would draw the bricks in the wrong places, so openSpectate() refuses it.
+// the alive bits go as 32-bit words: a keyframe sends the number of words and
+// every word, a frame that broke bricks sends the words that changed as
+// { index, old ^ new } pairs.
+// when the broadcast ends, a footer indexes the keyframes:
+//     { frame, offset } * count, count, STREAM_INDEX_MAGIC    (32-bit each)
+// so playback can jump to any frame by decoding at most one keyframe interval.
+// -----------------------------------------------------------------------------
+#define STREAM_MAGIC 0x32534c56         // "VLS2"
+#define STREAM_INDEX_MAGIC 0x58444e49   // "INDX"
+#define STREAM_MAX_KEYFRAMES (1 << 16)  // 36 hours at 60 fps
+#define STREAM_QUANT 512.0f             // positions are sent in 1/512 units
+#define STREAM_KEYFRAME_INTERVAL 120
+
+enum { FRAME_KEY = 1, FRAME_BALL = 2, FRAME_PADDLE = 4, FRAME_BRICKS = 8, FRAME_STARTED = 16 };
+
+// the part of SimState a spectator sees, quantized
+struct StreamState {
+    int ball_x, ball_z;
+    int paddle_x;
+    unsigned int alive[ALIVE_WORDS];    // as in SimState
+    bool started;
+};
+
+struct StreamKeyframe {
+    unsigned int frame;
+    unsigned int offset;
+};
+
+FILE* g_broadcast = NULL;
+FILE* g_spectate = NULL;
+StreamState g_streamState;
+unsigned int g_streamFrame = 0;         // frame written next, or decoded next when spectating
+long g_spectateEnd = 0;                 // frame records end here (start of the footer)
+std::vector<StreamKeyframe> g_keyframes;
+
+void writeVarint(FILE* file, unsigned int value)
+{
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7f) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+bool readVarint(FILE* file, unsigned int* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF)
+            return false;
+        *value |= (unsigned int)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+// zigzag keeps small negative deltas small
+void writeSigned(FILE* file, int value)
+{
+    writeVarint(file, ((unsigned int)value << 1) ^ (unsigned int)(value >> 31));
+}
+
+bool readSigned(FILE* file, int* value)
+{
+    unsigned int raw;
+    if (!readVarint(file, &raw))
+        return false;
+    *value = (int)(raw >> 1) ^ -(int)(raw & 1);
+    return true;
+}
+
+int quantize(float v) { return (int)floor(v * STREAM_QUANT + 0.5f); }
+float dequantize(int v) { return v / STREAM_QUANT; }
+
+StreamState captureStream(const SimState& state)
+{
+    StreamState s;
+    s.ball_x = quantize(state.ball.x);
+    s.ball_z = quantize(state.ball.z);
+    s.paddle_x = quantize(state.paddle.x);
+    memcpy(s.alive, state.alive, sizeof(s.alive));
+    s.started = state.started;
+    return s;
+}
+
+void applyStream(SimState& state, const StreamState& s)
+{
+    state.paddle.x = dequantize(s.paddle_x);
+    state.ball.x = dequantize(s.ball_x);
+    state.ball.z = dequantize(s.ball_z);
+    memcpy(state.alive, s.alive, sizeof(state.alive));
+    state.started = s.started;
+}
+
+void encodeFrame(FILE* file, const StreamState& prev, const StreamState& cur, bool key)
+{
+    unsigned int flags = cur.started ? FRAME_STARTED : 0;
+    if (key)
+        flags |= FRAME_KEY;
+    else {
+        if (cur.ball_x != prev.ball_x || cur.ball_z != prev.ball_z)
+            flags |= FRAME_BALL;
+        if (cur.paddle_x != prev.paddle_x)
+            flags |= FRAME_PADDLE;
+        if (memcmp(cur.alive, prev.alive, sizeof(cur.alive)) != 0)
+            flags |= FRAME_BRICKS;
+    }
+
+    writeVarint(file, flags);
+    if (key) {
+        writeSigned(file, cur.ball_x);
+        writeSigned(file, cur.ball_z);
+        writeSigned(file, cur.paddle_x);
+        writeVarint(file, ALIVE_WORDS);
+        for (int w = 0; w < ALIVE_WORDS; w++)
+            writeVarint(file, cur.alive[w]);
+        return;
+    }
+    if (flags & FRAME_BALL) {
+        writeSigned(file, cur.ball_x - prev.ball_x);
+        writeSigned(file, cur.ball_z - prev.ball_z);
+    }
+    if (flags & FRAME_PADDLE)
+        writeSigned(file, cur.paddle_x - prev.paddle_x);
+    if (flags & FRAME_BRICKS) {
+        unsigned int changed = 0;
+        for (int w = 0; w < ALIVE_WORDS; w++)
+            changed += cur.alive[w] != prev.alive[w];
+        writeVarint(file, changed);
+        for (int w = 0; w < ALIVE_WORDS; w++) {
+            if (cur.alive[w] != prev.alive[w]) {
+                writeVarint(file, w);
+                writeVarint(file, cur.alive[w] ^ prev.alive[w]);
+            }
+        }
+    }
+}
+
+// reads the next frame on top of state. false at the end of the stream.
+bool decodeFrame(FILE* file, StreamState& state)
+{
+    unsigned int flags, words, word, bits;
+    int delta;
+
+    if (!readVarint(file, &flags))
+        return false;
+
+    if (flags & FRAME_KEY) {
+        if (!readSigned(file, &state.ball_x) || !readSigned(file, &state.ball_z) ||
+            !readSigned(file, &state.paddle_x) || !readVarint(file, &words) || words > ALIVE_WORDS)
+            return false;
+        memset(state.alive, 0, sizeof(state.alive));
+        for (word = 0; word < words; word++) {
+            if (!readVarint(file, &state.alive[word])) return false;
+        }
+    }
+    else {
+        if (flags & FRAME_BALL) {
+            if (!readSigned(file, &delta)) return false;
+            state.ball_x += delta;
+            if (!readSigned(file, &delta)) return false;
+            state.ball_z += delta;
+        }
+        if (flags & FRAME_PADDLE) {
+            if (!readSigned(file, &delta)) return false;
+            state.paddle_x += delta;
+        }
+        if (flags & FRAME_BRICKS) {
+            if (!readVarint(file, &words) || words > ALIVE_WORDS) return false;
+            while (words-- > 0) {
+                if (!readVarint(file, &word) || word >= ALIVE_WORDS || !readVarint(file, &bits)) return false;
+                state.alive[word] ^= bits;
+            }
+        }
+    }
+    state.started = (flags & FRAME_STARTED) != 0;
+    return true;
+}
+
+bool openBroadcast(const char* fileName)
+{
+    g_broadcast = fopen(fileName, "wb");
+    if (NULL == g_broadcast)
+        return false;
+    writeVarint(g_broadcast, STREAM_MAGIC);
+    writeVarint(g_broadcast, (unsigned int)g_level.count);
+    writeVarint(g_broadcast, hashLevel(g_level));
+    g_keyframes.clear();
+    g_keyframes.reserve(STREAM_MAX_KEYFRAMES);    // no allocation while recording
+    return true;
+}
+
+// writes the frame of g_state that follows the last one written
+void broadcastFrame(void)
+{
+    bool key = g_streamFrame % STREAM_KEYFRAME_INTERVAL == 0;
+    if (key && g_keyframes.size() < STREAM_MAX_KEYFRAMES) {
+        StreamKeyframe keyframe = { g_streamFrame, (unsigned int)ftell(g_broadcast) };
+        g_keyframes.push_back(keyframe);
+    }
+
+    StreamState current = captureStream(g_state);
+    encodeFrame(g_broadcast, g_streamState, current, key);
+    g_streamState = current;
+    g_streamFrame++;
+}
+
+bool openSpectate(const char* fileName)
+{
+    unsigned int magic, count, bricks, level;
+    g_spectate = fopen(fileName, "rb");
+    if (NULL == g_spectate)
+        return false;
+    if (!readVarint(g_spectate, &magic) || magic != STREAM_MAGIC ||
+        !readVarint(g_spectate, &bricks) || bricks != (unsigned int)g_level.count ||
+        !readVarint(g_spectate, &level) || level != hashLevel(g_level)) {
+        fclose(g_spectate);
+        g_spectate = NULL;
+        return false;
+    }
+    long start = ftell(g_spectate);
+
+    // load the keyframe index. a stream without one still plays, but can't seek
+    g_keyframes.clear();
+    fseek(g_spectate, 0, SEEK_END);
+    g_spectateEnd = ftell(g_spectate);
+    if (g_spectateEnd >= start + 8 && 0 == fseek(g_spectate, -8, SEEK_END) &&
+        1 == fread(&count, sizeof(count), 1, g_spectate) && 1 == fread(&magic, sizeof(magic), 1, g_spectate) &&
+        magic == STREAM_INDEX_MAGIC && count <= STREAM_MAX_KEYFRAMES)
+    {
+        long footer = g_spectateEnd - 8 - (long)(count * sizeof(StreamKeyframe));
+        g_keyframes.resize(count);
+        fseek(g_spectate, footer, SEEK_SET);
+        if (count > 0 && count != fread(&g_keyframes[0], sizeof(StreamKeyframe), count, g_spectate))
+            g_keyframes.clear();
+        else
+            g_spectateEnd = footer;
+    }
+
+    fseek(g_spectate, start, SEEK_SET);
+    g_streamFrame = 0;
+    return true;
+}
+
+// decodes the next frame of the spectated stream into g_streamState. false at the end.
+bool spectateFrame(void)
+{
+    if (ftell(g_spectate) >= g_spectateEnd || !decodeFrame(g_spectate, g_streamState))
+        return false;
+    g_streamFrame++;
+    return true;
+}
+
+// positions playback so the next frame shown is frame (or the last one, past the end)
+void seekSpectate(long frame)
+{
+    if (NULL == g_spectate || g_keyframes.empty())
+        return;
+    if (frame < 0)
+        frame = 0;
+
+    // last keyframe at or before frame
+    size_t lo = 0, hi = g_keyframes.size();
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (g_keyframes[mid].frame <= (unsigned int)frame)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    fseek(g_spectate, (long)g_keyframes[lo].offset, SEEK_SET);
+    g_streamFrame = g_keyframes[lo].frame;
+    while (g_streamFrame < (unsigned int)frame && spectateFrame())
+        ;
+}
+
+void closeStreams(void)
+{
+    if (g_broadcast != NULL) {
+        unsigned int count = (unsigned int)g_keyframes.size();
+        unsigned int magic = STREAM_INDEX_MAGIC;
+        if (count > 0)
+            fwrite(&g_keyframes[0], sizeof(StreamKeyframe), count, g_broadcast);
+        fwrite(&count, sizeof(count), 1, g_broadcast);
+        fwrite(&magic, sizeof(magic), 1, g_broadcast);
+        fclose(g_broadcast);
+        g_broadcast = NULL;
+    }
+    if (g_spectate != NULL) {
+        fclose(g_spectate);
+        g_spectate = NULL;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Game grid
+// -grid <n> plays n games side by side, each in its own viewport tile. they are
+// training environments (legoEnv.h) on the level of the game, driven by an
+// autopilot that follows the ball. every tile aims the paddle off center by its
+// own amount, spread evenly over the paddle by the golden ratio sequence, so no
+// two games play alike. the tiles are drawn from the observation rows.
+// drawing goes pass by pass (tables, bricks, paddles, balls) over all tiles:
+// mesh and material are set once per pass, only the viewport and the transform
+// change between tiles.
+// -----------------------------------------------------------------------------
+#define GRID_MAX_TILES 64   // also keeps LegoEnvStep() on this thread
+#define GRID_AIM_RANGE 0.4f // the autopilot hits the ball up to half this off center
+
+LegoEnvs* g_grid = NULL;
+int g_gridColumns = 0;
+int g_gridRows = 0;
+std::vector<LegoAction> g_gridActions;
+std::vector<float> g_gridObservations;
+std::vector<float> g_gridRewards;
+std::vector<unsigned char> g_gridDones;
+std::vector<float> g_gridAim;           // paddle offset from the ball, per tile
+
+bool openGrid(int tiles)
+{
+    if (tiles < 1 || tiles > GRID_MAX_TILES)
+        return false;
+    g_grid = LegoEnvCreate(tiles, g_levelFile.name[0] != 0 ? g_levelFile.name : NULL);
+    if (NULL == g_grid)
+        return false;
+
+    g_gridColumns = (int)ceil(sqrt((double)tiles));
+    g_gridRows = (tiles + g_gridColumns - 1) / g_gridColumns;
+    g_gridActions.resize(tiles);
+    g_gridObservations.resize(tiles * LEGO_ENV_OBS_SIZE);
+    g_gridRewards.resize(tiles);
+    g_gridDones.resize(tiles);
+    g_gridAim.resize(tiles);
+    for (int t = 0; t < tiles; t++)
+        g_gridAim[t] = (float)(fmod(t * 0.6180339887, 1.0) - 0.5) * GRID_AIM_RANGE;
+    LegoEnvReset(g_grid, &g_gridObservations[0]);
+    return true;
+}
+
+void closeGrid(void)
+{
+    LegoEnvDestroy(g_grid);
+    g_grid = NULL;
+}
+
+// the games start over on a level file that was just reloaded
+void reopenGrid(void)
+{
+    if (NULL == g_grid)
+        return;
+    int tiles = (int)g_gridActions.size();
+    closeGrid();
+    openGrid(tiles);
+}
+
+void stepGrid(void)
+{
+    d3d::TraceScope trace("stepGrid");
+    int tiles = (int)g_gridActions.size();
+    for (int t = 0; t < tiles; t++) {
+        const float* row = &g_gridObservations[t * LEGO_ENV_OBS_SIZE];
+        g_gridActions[t].paddle_x = row[LEGO_ENV_OBS_BALL_X] + g_gridAim[t];
+        g_gridActions[t].launch = 1;
+    }
+    LegoEnvStep(g_grid, &g_gridActions[0], &g_gridObservations[0], &g_gridRewards[0], &g_gridDones[0]);
+}
+
+void drawGridSphere(ID3DXMesh* mesh, float x, float y, float z)
+{
+    D3DXMATRIX m;
+    D3DXMatrixTranslation(&m, x, y, z);
+    m = m * g_mWorld;
+    Device->SetTransform(D3DTS_WORLD, &m);
+    mesh->DrawSubset(0);
+}
+
+void drawGrid(void)
+{
+    int tiles = (int)g_gridActions.size();
+    int t, i;
+
+    D3DVIEWPORT9 full;
+    D3DVIEWPORT9 tile[GRID_MAX_TILES];
+    Device->GetViewport(&full);
+    for (t = 0; t < tiles; t++) {
+        int column = t % g_gridColumns;
+        int row = t / g_gridColumns;
+        tile[t].X = full.X + full.Width * column / g_gridColumns;
+        tile[t].Y = full.Y + full.Height * row / g_gridRows;
+        tile[t].Width = full.X + full.Width * (column + 1) / g_gridColumns - tile[t].X;
+        tile[t].Height = full.Y + full.Height * (row + 1) / g_gridRows - tile[t].Y;
+        tile[t].MinZ = 0.0f;
+        tile[t].MaxZ = 1.0f;
+    }
+
+    // same camera as the single game, with the aspect ratio of a tile
+    D3DXMATRIX proj;
+    D3DXMatrixPerspectiveFovLH(&proj, D3DX_PI / 4,
+        (float)tile[0].Width / (float)tile[0].Height, 1.0f, 100.0f);
+    Device->SetTransform(D3DTS_PROJECTION, &proj);
+
+    // tables: plane and walls never move, they are the same in every tile
+    for (t = 0; t < tiles; t++) {
+        Device->SetViewport(&tile[t]);
+        g_legoPlane.draw(Device, g_mWorld);
+        for (i = 0; i < wall_num; i++) {
+            g_legowall[i].draw(Device, g_mWorld);
+        }
+    }
+
+    // bricks, paddles and balls all use the shared sphere mesh
+    ID3DXMesh* mesh = CSphere::getSharedMesh();
+    if (mesh != NULL) {
+        if (g_level.count > 0) {
+            Device->SetMaterial(&g_sphere[0].getMaterial());
+            for (t = 0; t < tiles; t++) {
+                Device->SetViewport(&tile[t]);
+                const float* row = &g_gridObservations[t * LEGO_ENV_OBS_SIZE];
+                for (i = 0; i < g_level.count; i++) {
+                    if (row[LEGO_ENV_OBS_BRICKS + i] != 0)
+                        drawGridSphere(mesh, g_level.pos[i][0], g_tuning.radius, g_level.pos[i][1]);
+                }
+            }
+        }
+        Device->SetMaterial(&g_target_whiteball.getMaterial());
+        for (t = 0; t < tiles; t++) {
+            Device->SetViewport(&tile[t]);
+            const float* row = &g_gridObservations[t * LEGO_ENV_OBS_SIZE];
+            drawGridSphere(mesh, row[LEGO_ENV_OBS_PADDLE_X], BALL_Y, PADDLE_Z);
+        }
+        Device->SetMaterial(&red_ball.getMaterial());
+        for (t = 0; t < tiles; t++) {
+            Device->SetViewport(&tile[t]);
+            const float* row = &g_gridObservations[t * LEGO_ENV_OBS_SIZE];
+            drawGridSphere(mesh, row[LEGO_ENV_OBS_BALL_X], BALL_Y, row[LEGO_ENV_OBS_BALL_Z]);
+        }
+    }
+
+    Device->SetViewport(&full);
+    Device->SetTransform(D3DTS_PROJECTION, &g_mProj);
+}
+
+// the strips of the table the camera sees, each as a sphere around its bricks
+void seenStrips(const d3d::Frustum& frustum, bool seen[CHUNK_COUNT])
+{
+    d3d::SphereBatch strips;
+    float halfWidth = TABLE_WIDTH / 2 + g_tuning.radius;
+    float halfDepth = CHUNK_DEPTH / 2 + g_tuning.radius;
+    float radius = sqrtf(halfWidth * halfWidth + halfDepth * halfDepth + g_tuning.radius * g_tuning.radius);
+    for (int c = 0; c < CHUNK_COUNT; c++)
+        strips.add(D3DXVECTOR3(0.0f, g_tuning.radius, TABLE_NEAR_Z + (c + 0.5f) * CHUNK_DEPTH), radius);
+    frustum.cull(strips);
+    for (int c = 0; c < CHUNK_COUNT; c++)
+        seen[c] = strips._visible[c];
+}
+
+// draw plane, walls, spheres and particles of the one game in the window
+void drawWorld(void)
+{
+    int i = 0;
+
+    // test every object against the view frustum in one batch. the objects are
+    // placed in table space and then moved by g_mWorld, so the frustum is built
+    // from the whole world * view * projection chain. only the bricks of the
+    // resident strips take part; the others are out of view and away from the ball.
+    d3d::Frustum frustum;
+    d3d::SphereBatch batch;
+    frustum.build(g_mWorld * g_mView * g_mProj);
+    bool seen[CHUNK_COUNT];
+    seenStrips(frustum, seen);
+    updateResidency(g_level, g_state, seen, g_residency);
+    placeBalls();
+
+    batch.add(g_legoPlane.getCenter(), g_legoPlane.getBoundRadius());
+    for (i = 0; i < wall_num; i++) {
+        batch.add(g_legowall[i].getCenter(), g_legowall[i].getBoundRadius());
+    }
+    for (i = 0; i < g_residency.count; i++) {
+        const CSphere& brick = g_sphere[g_residency.bricks[i]];
+        batch.add(brick.getCenter(), brick.getRadius());
+    }
+    batch.add(g_target_whiteball.getCenter(), g_target_whiteball.getRadius());
+    batch.add(red_ball.getCenter(), red_ball.getRadius());
+    batch.add(g_rival_whiteball.getCenter(), g_rival_whiteball.getRadius());
+    g_stats.culled = frustum.cull(batch) + g_level.count - g_residency.count;
+
+    int k = 0;
+    if (batch._visible[k++])
+        g_legoPlane.draw(Device, g_mWorld);
+    for (i = 0; i < wall_num; i++) {
+        if (batch._visible[k++])
+            g_legowall[i].draw(Device, g_mWorld);
+    }
+    for (i = 0; i < g_residency.count; i++) {
+        int brick = g_residency.bricks[i];
+        if (batch._visible[k++] == false || !brickAlive(g_state, brick))
+            continue;
+        g_sphere[brick].draw(Device, g_mWorld);
+    }
+    if (batch._visible[k++])
+        g_target_whiteball.draw(Device, g_mWorld);
+    if (batch._visible[k++])
+        red_ball.draw(Device, g_mWorld);
+    if (batch._visible[k++] && g_state.versus)
+        g_rival_whiteball.draw(Device, g_mWorld);
+    g_light.draw(Device);
+    g_particleBuffer.draw(Device, g_mWorld, g_particles);
+}
+
+// draw the frame (one game or the grid) and show it
+void drawScene(void)
+{
+    d3d::TraceScope trace("draw");
+    double drawStart = d3d::SystemClock();
+
+    Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, CLEAR_COLOR, 1.0f, 0);
+    Device->BeginScene();
+
+    if (g_grid != NULL)
+        drawGrid();
+    else
+        drawWorld();
+
+    Device->EndScene();
+
+    double presentStart = d3d::SystemClock();
+    {
+        d3d::TraceScope tracePresent("Present");
+        Device->Present(0, 0, 0, 0);
+        Device->SetTexture(0, NULL);
+    }
+
+    g_stats.drawMs = (float)((presentStart - drawStart) * 1000.0);
+    g_stats.presentMs = (float)((d3d::SystemClock() - presentStart) * 1000.0);
+}
+
+// renders the board on the CPU (softRender.h) into an image file, for -shot
+bool renderShot(const char* fileName, bool wire)
+{
+    int threads = (int)std::thread::hardware_concurrency();
+    SoftRenderer renderer(Width, Height, threads > 0 ? threads : 1);
+    SoftBoard board;
+    buildBoard(board, g_tuning.radius, QUALITY[g_quality].sphereSlices);
+    renderer.setWireframe(wire);
+    drawBoard(renderer, board, g_level, g_state);
+    renderer.render();
+    return renderer.save(fileName);
+}
+
+// runs the ticks of one versus frame, as far as the inputs of both players
+// got, and sends the other side what it is missing
+void stepVersus(float timeDelta)
+{
+    netPoll(g_net, g_state);
+    g_simTime += timeDelta;
+    if (g_simTime > SIM_STEP * MAX_FRAME_TICKS)
+        g_simTime = SIM_STEP * MAX_FRAME_TICKS;
+    while (g_simTime >= SIM_STEP) {
+        // after a stall the tick has its input already, a launch waits for the next one
+        if (netQueueInput(g_net, g_input))
+            g_input.launch = false;
+        if (!netStep(g_net, g_level, g_state))
+            break;
+        g_simTime -= SIM_STEP;
+    }
+    netSend(g_net, g_state);
+
+    bool latencyOk = netLatencyOk(g_net);
+    if (latencyOk != g_netLatencyOk) {
+        g_netLatencyOk = latencyOk;
+        ::OutputDebugString(latencyOk ? "versus: the latency fits the input delay again\n" :
+            "versus: the one-way latency is above the input delay, the game will stall\n");
+    }
+
+    unsigned int score = g_state.score[0] | ((unsigned int)g_state.score[1] << 16);
+    if (score != g_netScore) {
+        g_netScore = score;
+        int me = netPlayer(g_net);
+        char title[64];
+        D3DDEVICE_CREATION_PARAMETERS params;
+        snprintf(title, sizeof(title), "Virtual Billiard - you %d : %d other",
+            g_state.score[me], g_state.score[1 - me]);
+        if (SUCCEEDED(Device->GetCreationParameters(&params)))
+            ::SetWindowText(params.hFocusWindow, title);
+    }
+}
+
+// timeDelta represents the time between the current image frame and the last image frame.
+// the distance of moving balls should be "velocity * timeDelta"
+// returns true while the ball is in play, false when the scene only changes on input
+bool Display(float timeDelta)
+{
+    d3d::TraceScope trace("Display");
+    int i = 0;
+    static double lastFrameStart = d3d::SystemClock();
+    double frameStart = d3d::SystemClock();
+
+    if (NULL == Device)
+        return false;
+
+    checkReload();
+
+    // everything WndProc collected since the last frame shows up in this one
+    double inputTime = g_inputTime;
+    g_inputTime = 0;
+    applyDrag();
+#ifdef _DEBUG
+    // reloads and quality changes rebuild meshes and may allocate, the frame may not
+    long allocBefore = g_allocCount;
+#endif
+
+    g_stats.frame++;
+    g_stats.frameMs = (float)((frameStart - lastFrameStart) * 1000.0);
+    lastFrameStart = frameStart;
+
+    SimState before = g_state;      // for the bricks that break
+
+    bool animating = true;
+    if (g_spectate != NULL)
+    {
+        // spectator: the state comes from the stream, input is ignored
+        if (spectateFrame())
+            applyStream(g_state, g_streamState);
+        else
+            animating = false;
+        g_stats.collisions = 0;
+    }
+    else if (g_grid != NULL)
+    {
+        // grid: the games play themselves, the game in the window waits
+        stepGrid();
+        g_stats.collisions = 0;
+    }
+    else if (g_net != NULL)
+    {
+        // versus: the frames go on while waiting for the other side
+        t_events = eventSink(&g_gameEvents);
+        {
+            d3d::TraceScope traceSimulate("simulate");
+            stepVersus(timeDelta);
+        }
+        t_events = NULL;
+        g_stats.collisions = 0;
+    }
+    else
+    {
+        t_events = eventSink(&g_gameEvents);
+        g_stats.collisions = 0;
+        g_simTime += timeDelta;
+        if (g_simTime > SIM_STEP * MAX_FRAME_TICKS)
+            g_simTime = SIM_STEP * MAX_FRAME_TICKS;
+        {
+            d3d::TraceScope traceSimulate("simulate");
+            while (g_simTime >= SIM_STEP) {
+                pushSnapshot(g_snapshots, g_state);
+                applyInput(g_state, g_input);
+                g_input.launch = false;
+                g_stats.collisions += simulate(g_level, g_state, SIM_STEP);
+                g_simTime -= SIM_STEP;
+            }
+        }
+        t_events = NULL;
+        // input that no tick took yet keeps the frames coming
+        animating = g_state.started || g_input.launch || g_input.paddle_x != g_state.paddle.x;
+
+        if (g_broadcast != NULL)
+            broadcastFrame();
+    }
+
+    // bricks that broke this frame burst into debris and sparks
+    for (i = 0; i < g_level.count; i++) {
+        if (brickAlive(before, i) && !brickAlive(g_state, i)) {
+            float x = g_level.pos[i][0], z = g_level.pos[i][1];
+            g_particles.emit(x, g_tuning.radius, z, 400, 1.0f, 1.5f, d3d::YELLOW);
+            g_particles.emit(x, g_tuning.radius, z, 100, 2.5f, 0.6f, d3d::WHITE);
+        }
+    }
+    {
+        d3d::TraceScope traceParticles("particles");
+        g_particles.update(timeDelta * g_tuning.time_scale);
+    }
+    if (g_particles.getCount() > 0)
+        animating = true;
+
+    g_stats.simMs = (float)((d3d::SystemClock() - frameStart) * 1000.0);
+    g_stats.liveBricks = countBricks(g_state);
+    g_stats.ballVx = g_state.ball.vx;
+    g_stats.ballVz = g_state.ball.vz;
+
+    drawScene();
+    g_stats.inputMs = inputTime != 0 ? recordLatency(inputTime) : 0.0f;
+    publishTelemetry(g_stats);
+
+#ifdef _DEBUG
+    assert(g_allocCount == allocBefore);
+#endif
+    governQuality((d3d::SystemClock() - frameStart) * 1000.0);
+    return animating;
+}
+
+// 콺  Ƹ
+LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    static bool wire = false;
     static bool isReset = true;
     static int old_x = 0;
     static int old_y = 0;
     static enum { WORLD_MOVE, LIGHT_MOVE, BLOCK_MOVE } move = WORLD_MOVE;
+    d3d::TraceScope trace("WndProc");
 
     switch (msg) {
     case WM_DESTROY:
@@ -698,6 +1930,28 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         case VK_ESCAPE:
             ::DestroyWindow(hwnd);
             break;
+        case VK_LEFT:
+        case VK_RIGHT:
+            // spectating: jump five seconds back or forward
+            seekSpectate((long)g_streamFrame + (wParam == VK_LEFT ? -300 : 300));
+            break;
+        case 'H':
+            // hint: move the paddle to the best launch position found in one frame's time
+            if (!g_state.started && g_net == NULL)
+                g_input.paddle_x = findBestShot(g_state, 10000, 16.0);
+            break;
+        case VK_BACK:
+            // rewind one second, not in a versus game the other side plays on
+            if (g_spectate == NULL && g_net == NULL && (rollback(g_snapshots, 60, g_state) || rollback(g_snapshots, g_snapshots.count, g_state)))
+                g_input.paddle_x = g_state.paddle.x;
+            break;
+        case VK_F9:
+            // start/stop recording a Chrome trace
+            if (d3d::TracingOn)
+                d3d::StopTracing("trace.json");
+            else
+                d3d::StartTracing();
+            break;
         case VK_RETURN:
             if (NULL != Device) {
                 wire = !wire;
@@ -706,10 +1960,8 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             }
             break;
         case VK_SPACE:
-            if (!startflag)
-                red_ball.setPower(0, 2);
-            startflag = true;
-
+            g_input.launch = true;
+            noteInput();
             break;
 
         }
@@ -721,7 +1973,6 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         int new_x = LOWORD(lParam);
         int new_y = HIWORD(lParam);
         float dx;
-        float dy;
 
         if (LOWORD(wParam) & MK_LBUTTON) {
 
@@ -729,20 +1980,12 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
                 isReset = false;
             }
             else {
-                D3DXVECTOR3 vDist;
-                D3DXVECTOR3 vTrans;
-                D3DXMATRIX mTrans;
-                D3DXMATRIX mX;
-                D3DXMATRIX mY;
-
                 switch (move) {
                 case WORLD_MOVE:
-                    dx = (old_x - new_x) * 0.01f;
-                    dy = (old_y - new_y) * 0.01f;
-                    D3DXMatrixRotationY(&mX, dx);
-                    D3DXMatrixRotationX(&mY, dy);
-                    g_mWorld = g_mWorld * mX * mY;
-
+                    // applied once per frame by applyDrag()
+                    g_dragX += old_x - new_x;
+                    g_dragY += old_y - new_y;
+                    noteInput();
                     break;
                 }
             }
@@ -757,8 +2000,8 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             if (LOWORD(wParam) & MK_RBUTTON) {
                 dx = (old_x - new_x);// * 0.01f;
 
-                D3DXVECTOR3 coord3d = g_target_whiteball.getCenter();
-                g_target_whiteball.setCenter(coord3d.x + dx * (-0.007f), coord3d.y, -4.5f);
+                g_input.paddle_x += dx * (-0.007f);
+                noteInput();
             }
             old_x = new_x;
             old_y = new_y;
@@ -779,6 +2022,51 @@ int WINAPI WinMain(HINSTANCE hinstance,
 {
     srand(static_cast<unsigned int>(time(NULL)));
 
+    // -level <file> and -tuning <file> are loaded now and reloaded whenever they change
+    defaultLevel(g_level);
+    if (getOption(cmdLine, "-level", g_levelFile.name, sizeof(g_levelFile.name))) {
+        fileChanged(g_levelFile);
+        int count = loadLevel(g_levelFile.name, g_level.pos);
+        if (count >= 0)
+            g_level.count = count;
+    }
+    if (getOption(cmdLine, "-tuning", g_tuningFile.name, sizeof(g_tuningFile.name))) {
+        fileChanged(g_tuningFile);
+        readTuning(g_tuningFile.name, g_tuning);
+    }
+
+    // -frametrace <file> only runs the quality governor over recorded frame times
+    char traceFile[MAX_PATH];
+    if (getOption(cmdLine, "-frametrace", traceFile, sizeof(traceFile))) {
+        if (!runFrameTrace(traceFile))
+            ::MessageBox(0, "-frametrace: cannot read file", 0, 0);
+        return 0;
+    }
+
+    // -quality <0..3> fixes the quality level instead of adapting it
+    char quality[16];
+    if (getOption(cmdLine, "-quality", quality, sizeof(quality))) {
+        int level = atoi(quality);
+        level = level < 0 ? 0 : (level >= QUALITY_LEVELS ? QUALITY_LEVELS - 1 : level);
+        g_qualityFixed = true;
+        g_quality = level;
+        CSphere::setDetail(QUALITY[level].sphereSlices);
+        g_particles.setLimit(QUALITY[level].particles);
+    }
+
+    // -shot <file> renders the first frame on the CPU, saves it and quits. it
+    // needs no GPU and opens no window. -wireframe draws the edges only.
+    char shotFile[MAX_PATH];
+    if (getOption(cmdLine, "-shot", shotFile, sizeof(shotFile))) {
+        resetState(g_level, g_state);
+        buildChunks(g_level);
+        return renderShot(shotFile, getOption(cmdLine, "-wireframe")) ? 0 : 1;
+    }
+
+    // -trace records from startup on; F9 stops and writes trace.json
+    if (getOption(cmdLine, "-trace"))
+        d3d::StartTracing();
+
     if (!d3d::InitD3D(hinstance,
         Width, Height, true, D3DDEVTYPE_HAL, &Device))
     {
@@ -792,8 +2080,66 @@ int WINAPI WinMain(HINSTANCE hinstance,
         return 0;
     }
 
+    openTelemetry();
+
+    // -broadcast <file> records a spectator stream, -spectate <file> plays one back
+    char streamFile[MAX_PATH];
+    if (getOption(cmdLine, "-broadcast", streamFile, sizeof(streamFile)) && !openBroadcast(streamFile))
+        ::MessageBox(0, "-broadcast: cannot open file", 0, 0);
+    if (getOption(cmdLine, "-spectate", streamFile, sizeof(streamFile)) && !openSpectate(streamFile))
+        ::MessageBox(0, "-spectate: not a spectator stream of this level", 0, 0);
+
+    // -events <file> records what happens in the game (and the grid) for analysis
+    char eventFile[MAX_PATH];
+    if (getOption(cmdLine, "-events", eventFile, sizeof(eventFile))) {
+        if (openEvents(eventFile))
+            g_state.session = newSession();
+        else
+            ::MessageBox(0, "-events: cannot create file", 0, 0);
+    }
+
+    // -grid <n> shows n (up to 64) self-playing games at once
+    char gridSize[16];
+    if (getOption(cmdLine, "-grid", gridSize, sizeof(gridSize)) && !openGrid(atoi(gridSize)))
+        ::MessageBox(0, "-grid: 1 to 64 games", 0, 0);
+
+    // -host <port> or -join <name:port> start a versus game. -netdelay <ms> and
+    // -netloss <percent> hold back and drop packets that arrive, to try a bad
+    // connection with both games on one machine.
+    char netAddress[MAX_PATH];
+    bool host = getOption(cmdLine, "-host", netAddress, sizeof(netAddress));
+    if (host)
+        g_net = netHost((unsigned short)atoi(netAddress), d3d::SystemClock);
+    else if (getOption(cmdLine, "-join", netAddress, sizeof(netAddress)))
+        g_net = netJoin(netAddress, d3d::SystemClock);
+    else
+        netAddress[0] = '\0';
+    if (g_net != NULL) {
+        char value[16];
+        double delay = getOption(cmdLine, "-netdelay", value, sizeof(value)) ? atof(value) / 1000.0 : 0.0;
+        double loss = getOption(cmdLine, "-netloss", value, sizeof(value)) ? atof(value) / 100.0 : 0.0;
+        netSimulate(g_net, delay, loss);
+        g_state.versus = true;
+    }
+    else if (netAddress[0] != '\0')
+        ::MessageBox(0, host ? "-host: cannot open the port" : "-join: cannot reach the address", 0, 0);
+
     d3d::EnterMsgLoop(Display);
 
+    if (d3d::TracingOn)
+        d3d::StopTracing("trace.json");
+
+    reportLatency();
+    netClose(g_net);
+    closeGrid();
+    flushEvents(g_gameEvents);
+    closeEvents();
+    if (eventsDropped() > 0) {
+        char line[64];
+        snprintf(line, sizeof(line), "events: %u dropped, the writer fell behind\n", eventsDropped());
+        ::OutputDebugString(line);
+    }
+    closeStreams();
     Cleanup();
 
     Device->Release();